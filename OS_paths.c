@@ -1,6 +1,7 @@
 #include "OS_paths.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -23,6 +24,11 @@ const char *get_pictures_path(void) {
     }
     return NULL;
 }
+
+bool replace_file(const char *from, const char *to) {
+    // rename() doesn't replace an existing file on Windows.
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
 #else
 //NEED TO TEST
 #include <sys/types.h>
@@ -39,4 +45,8 @@ char *get_pictures_path(void) {
     }
     return NULL;
 }
-#endif
\ No newline at end of file
+
+bool replace_file(const char *from, const char *to) {
+    return rename(from, to) == 0;
+}
+#endif
@@ -1,6 +1,8 @@
 #ifndef OS_PATHS_H
 #define OS_PATHS_H
 
+#include <stdbool.h>
+
 #ifdef _WIN32
 #define PATH_SEPARATOR '\\'
 #else
@@ -9,4 +11,8 @@
 
 const char *get_pictures_path(void);
 
+// Function that puts the file at from in place of the file at to in a single step, so a crash leaves one or the other.
+// Returns true if it was moved.
+bool replace_file(const char *from, const char *to);
+
 #endif
\ No newline at end of file
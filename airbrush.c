@@ -0,0 +1,85 @@
+#include "airbrush.h"
+#include "raster.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void seed_spray_random(SprayRandom *random, unsigned int seed)
+{
+    // splitmix32 spreads the seed over the lanes, xorshift only needs them not to be 0.
+    uint32_t state = seed;
+    for(int i = 0; i < 4; i++){
+        uint32_t z = (state += 0x9E3779B9u);
+        z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+        z ^= z >> 16;
+        random->lanes[i] = z ? z : 0x6D2B79F5u;
+    }
+}
+
+// Advances the four generators and stores a candidate dot of each in x and y, both in [-1, 1).
+// Returns a mask of the candidates that are inside the unit disc.
+static int next_candidates(SprayRandom *random, float x[4], float y[4])
+{
+#if defined(__SSE2__)
+    __m128i state = _mm_loadu_si128((const __m128i *)random->lanes);
+    state = _mm_xor_si128(state,_mm_slli_epi32(state,13));
+    state = _mm_xor_si128(state,_mm_srli_epi32(state,17));
+    state = _mm_xor_si128(state,_mm_slli_epi32(state,5));
+    _mm_storeu_si128((__m128i *)random->lanes,state);
+
+    // The low and high 16 bits are the two coordinates, moved to the centers of 65536 steps over [-1, 1).
+    const __m128 scale = _mm_set1_ps(2.0f / 65536.0f);
+    const __m128 offset = _mm_set1_ps(1.0f / 65536.0f - 1.0f);
+    __m128 cx = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(state,_mm_set1_epi32(0xFFFF))),scale),offset);
+    __m128 cy = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(state,16)),scale),offset);
+    __m128 distance = _mm_add_ps(_mm_mul_ps(cx,cx),_mm_mul_ps(cy,cy));
+    _mm_storeu_ps(x,cx);
+    _mm_storeu_ps(y,cy);
+    return _mm_movemask_ps(_mm_cmplt_ps(distance,_mm_set1_ps(1.0f)));
+#else
+    int inside = 0;
+    for(int i = 0; i < 4; i++){
+        uint32_t state = random->lanes[i];
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        random->lanes[i] = state;
+        x[i] = (float)(state & 0xFFFF) * (2.0f / 65536.0f) + (1.0f / 65536.0f - 1.0f);
+        y[i] = (float)(state >> 16) * (2.0f / 65536.0f) + (1.0f / 65536.0f - 1.0f);
+        if(x[i] * x[i] + y[i] * y[i] < 1.0f) inside |= 1 << i;
+    }
+    return inside;
+#endif
+}
+
+bool spray_dots(Color *pixels, int width, int height, int stride, SprayRandom *random, Vector2 center, float radius,
+                int count, Color color, Rectangle *bounds)
+{
+    if(count <= 0 || color.a == 0) return false;
+
+    int minX = width, minY = height, maxX = -1, maxY = -1;
+    // Candidates outside the disc are thrown away, so the dots are spread evenly without angles or square roots.
+    while(count > 0){
+        float x[4], y[4];
+        int inside = next_candidates(random,x,y);
+        for(int i = 0; i < 4 && count > 0; i++){
+            if(!(inside & (1 << i))) continue;
+            count--;
+            int px = (int)floorf(center.x + x[i] * radius);
+            int py = (int)floorf(center.y + y[i] * radius);
+            if(px < 0 || py < 0 || px >= width || py >= height) continue;
+            Color *pixel = pixels + (long)py * stride + px;
+            *pixel = blend_pixel(*pixel,color,color.a);
+            if(px < minX) minX = px;
+            if(px > maxX) maxX = px;
+            if(py < minY) minY = py;
+            if(py > maxY) maxY = py;
+        }
+    }
+    if(maxX < 0) return false;
+    *bounds = (Rectangle){minX,minY,maxX - minX + 1,maxY - minY + 1};
+    return true;
+}
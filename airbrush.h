@@ -0,0 +1,25 @@
+#ifndef AIRBRUSH_H
+#define AIRBRUSH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "include/raylib.h"
+
+// Definition of a SprayRandom that generates the positions of airbrush dots, four xorshift generators run side by side.
+// The same seed always gives the same dots, so sprays can be replayed.
+typedef struct s_sprayrandom
+{
+    uint32_t lanes[4];
+
+} SprayRandom;
+
+// Function that seeds random, any seed is valid.
+void seed_spray_random(SprayRandom *random, unsigned int seed);
+
+// Function that blends count dots of color into pixels, spread evenly over the disc of radius around center.
+// pixels, width, height and stride are as in fill_polygon(). Returns false when no dot landed on the pixels,
+// otherwise sets bounds to the region that changed.
+bool spray_dots(Color *pixels, int width, int height, int stride, SprayRandom *random, Vector2 center, float radius,
+                int count, Color color, Rectangle *bounds);
+
+#endif
@@ -0,0 +1,517 @@
+#include "autosave.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "compress.h"
+#include "threads.h"
+#include "OS_paths.h"
+
+#define RECOVERY_VERSION 1
+// "CPRC", version, width, height and tile size.
+#define RECOVERY_HEADER_SIZE 20
+// "TILE", column, row, width and height as 16 bit integers, then the size of the packed pixels that follow.
+#define TILE_RECORD_SIZE 16
+// "DONE" and the number of tiles of the batch it closes.
+#define COMMIT_RECORD_SIZE 8
+// The journal is rewritten once it's this many times larger than the latest version of its tiles,
+// unless it's smaller than MIN_COMPACT_SIZE.
+#define COMPACT_RATIO 4
+#define MIN_COMPACT_SIZE (4 * 1024 * 1024)
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+// Definition of a SavedTile, the latest version of a tile written into the journal and a hash of its pixels to tell when it changes.
+typedef struct
+{
+    uint64_t hash;
+    unsigned char *packed;
+    size_t size;
+
+} SavedTile;
+
+// Definition of a TileCopy, a tile copied from the canvas, its pixels top-down at offset in the pixels of its job.
+typedef struct
+{
+    int column;
+    int row;
+    int width;
+    int height;
+    size_t offset;
+
+} TileCopy;
+
+// Definition of an AutosaveJob, the tiles copied by one autosave. full is set when they cover a new canvas.
+typedef struct
+{
+    int width;
+    int height;
+    bool full;
+    TileCopy *tiles;
+    int tile_count;
+    Color *pixels;
+
+} AutosaveJob;
+
+// job and stop are protected by lock. file, the size of the journal and the saved tiles are only touched by the thread,
+// started and the size of the last canvas copied only by the main thread.
+struct s_autosave
+{
+    Thread *thread;
+    Mutex *lock;
+    Condition *wake;
+    AutosaveJob *job;
+    bool stop;
+    char *path;
+
+    FILE *file;
+    int width;
+    int height;
+    int columns;
+    int rows;
+    SavedTile *saved;
+    size_t saved_bytes;
+    size_t file_bytes;
+
+    bool started;
+    int canvas_width;
+    int canvas_height;
+};
+
+static void put_u16(unsigned char *out, unsigned int value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+    for(int i = 0; i < 4; i++) out[i] = value >> (8 * i);
+}
+
+static unsigned int get_u16(const unsigned char *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// FNV-1a over the pixels, two at a time.
+static uint64_t hash_pixels(const Color *pixels, int count)
+{
+    uint64_t hash = FNV_OFFSET;
+    int i = 0;
+    for(; i + 2 <= count; i += 2){
+        uint64_t pair;
+        memcpy(&pair,pixels + i,sizeof(pair));
+        hash = (hash ^ pair) * FNV_PRIME;
+    }
+    if(i < count){
+        uint32_t last;
+        memcpy(&last,pixels + i,sizeof(last));
+        hash = (hash ^ last) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static void free_job(AutosaveJob *job)
+{
+    if(!job) return;
+    free(job->tiles);
+    free(job->pixels);
+    free(job);
+}
+
+static void free_saved_tiles(Autosave *autosave)
+{
+    if(autosave->saved){
+        for(int i = 0; i < autosave->columns * autosave->rows; i++) free(autosave->saved[i].packed);
+        free(autosave->saved);
+    }
+    autosave->saved = NULL;
+    autosave->saved_bytes = 0;
+}
+
+// JOURNAL
+
+static bool write_header(FILE *file, int width, int height)
+{
+    unsigned char header[RECOVERY_HEADER_SIZE];
+    memcpy(header,"CPRC",4);
+    put_u32(header + 4,RECOVERY_VERSION);
+    put_u32(header + 8,width);
+    put_u32(header + 12,height);
+    put_u32(header + 16,AUTOSAVE_TILE_SIZE);
+    return fwrite(header,1,sizeof(header),file) == sizeof(header);
+}
+
+static bool write_tile(FILE *file, int column, int row, int width, int height, const SavedTile *tile)
+{
+    unsigned char record[TILE_RECORD_SIZE];
+    memcpy(record,"TILE",4);
+    put_u16(record + 4,column);
+    put_u16(record + 6,row);
+    put_u16(record + 8,width);
+    put_u16(record + 10,height);
+    put_u32(record + 12,tile->size);
+    return fwrite(record,1,sizeof(record),file) == sizeof(record) && fwrite(tile->packed,1,tile->size,file) == tile->size;
+}
+
+static bool write_commit(FILE *file, int count)
+{
+    unsigned char record[COMMIT_RECORD_SIZE];
+    memcpy(record,"DONE",4);
+    put_u32(record + 4,count);
+    return fwrite(record,1,sizeof(record),file) == sizeof(record) && fflush(file) == 0;
+}
+
+static void saved_tile_size(const Autosave *autosave, int column, int row, int *width, int *height)
+{
+    int x = column * AUTOSAVE_TILE_SIZE;
+    int y = row * AUTOSAVE_TILE_SIZE;
+    *width = autosave->width - x < AUTOSAVE_TILE_SIZE ? autosave->width - x : AUTOSAVE_TILE_SIZE;
+    *height = autosave->height - y < AUTOSAVE_TILE_SIZE ? autosave->height - y : AUTOSAVE_TILE_SIZE;
+}
+
+// Writes a new journal with the latest version of every tile as a single batch, then puts it in place of the old one.
+// Returns false, leaving the old journal as it was, if it couldn't be written.
+static bool rewrite_journal(Autosave *autosave)
+{
+    size_t length = strlen(autosave->path);
+    char *temporary = malloc(length + 5);
+    if(!temporary) return false;
+    sprintf(temporary,"%s.tmp",autosave->path);
+
+    FILE *file = fopen(temporary,"wb");
+    bool written = file && write_header(file,autosave->width,autosave->height);
+    size_t bytes = RECOVERY_HEADER_SIZE;
+    int count = 0;
+    for(int row = 0; written && row < autosave->rows; row++){
+        for(int column = 0; written && column < autosave->columns; column++){
+            SavedTile *tile = &autosave->saved[row * autosave->columns + column];
+            if(!tile->packed) continue;
+            int width, height;
+            saved_tile_size(autosave,column,row,&width,&height);
+            written = write_tile(file,column,row,width,height,tile);
+            bytes += TILE_RECORD_SIZE + tile->size;
+            count++;
+        }
+    }
+    written = written && write_commit(file,count);
+    if(file && fclose(file) != 0) written = false;
+    if(!written){
+        remove(temporary);
+        free(temporary);
+        return false;
+    }
+
+    if(autosave->file) fclose(autosave->file);
+    autosave->file = NULL;
+    // The old journal is only replaced in one step, it's kept as it was if that fails.
+    bool replaced = replace_file(temporary,autosave->path);
+    if(!replaced) remove(temporary);
+    free(temporary);
+    if(!replaced) return false;
+    autosave->file = fopen(autosave->path,"ab");
+    autosave->file_bytes = bytes + COMMIT_RECORD_SIZE;
+    return autosave->file != NULL;
+}
+
+// Starts a new journal for a canvas of width by height, forgetting every tile saved so far.
+// The old journal stays on disk until the tiles of the new one are written and replace it.
+static void start_journal(Autosave *autosave, int width, int height)
+{
+    free_saved_tiles(autosave);
+    if(autosave->file) fclose(autosave->file);
+    autosave->file = NULL;
+    autosave->width = width;
+    autosave->height = height;
+    autosave->columns = (width + AUTOSAVE_TILE_SIZE - 1) / AUTOSAVE_TILE_SIZE;
+    autosave->rows = (height + AUTOSAVE_TILE_SIZE - 1) / AUTOSAVE_TILE_SIZE;
+    autosave->saved = calloc((size_t)autosave->columns * autosave->rows,sizeof(SavedTile));
+    autosave->file_bytes = 0;
+    if(!autosave->saved) fprintf(stderr, "Warning: couldn't write the recovery file %s.\n",autosave->path);
+}
+
+// Appends the tiles of job that changed since they were last saved, closed by a commit record.
+static void write_job(Autosave *autosave, AutosaveJob *job)
+{
+    bool started = job->full || job->width != autosave->width || job->height != autosave->height || !autosave->saved;
+    if(started) start_journal(autosave,job->width,job->height);
+    if(!autosave->saved) return;
+    // A journal that couldn't be written is started again from the tiles kept in memory.
+    if(!started && !autosave->file && !rewrite_journal(autosave)) return;
+
+    int count = 0;
+    bool written = true;
+    for(int i = 0; written && i < job->tile_count; i++){
+        TileCopy *copy = &job->tiles[i];
+        const Color *pixels = job->pixels + copy->offset;
+        SavedTile *tile = &autosave->saved[copy->row * autosave->columns + copy->column];
+        uint64_t hash = hash_pixels(pixels,copy->width * copy->height);
+        if(tile->packed && tile->hash == hash) continue;
+
+        size_t size;
+        unsigned char *packed = pack_pixels(pixels,copy->width * copy->height,&size);
+        if(!packed) continue;
+        autosave->saved_bytes += size - tile->size;
+        free(tile->packed);
+        *tile = (SavedTile){hash,packed,size};
+        count++;
+        if(started) continue;
+        written = write_tile(autosave->file,copy->column,copy->row,copy->width,copy->height,tile);
+        autosave->file_bytes += TILE_RECORD_SIZE + size;
+    }
+    // A new journal is written aside with all its tiles, so a crash meanwhile still leaves the old one to recover.
+    if(started){
+        if(!rewrite_journal(autosave)) fprintf(stderr, "Warning: couldn't write the recovery file %s.\n",autosave->path);
+        return;
+    }
+    if(count == 0) return;
+    written = written && write_commit(autosave->file,count);
+    autosave->file_bytes += COMMIT_RECORD_SIZE;
+
+    if(!written){
+        fprintf(stderr, "Warning: failed to write the recovery file %s.\n",autosave->path);
+        fclose(autosave->file);
+        autosave->file = NULL;
+    }
+    else if(autosave->file_bytes > MIN_COMPACT_SIZE && autosave->file_bytes > COMPACT_RATIO * (autosave->saved_bytes + RECOVERY_HEADER_SIZE)){
+        rewrite_journal(autosave);
+    }
+}
+
+static void autosave_worker(void *arg)
+{
+    Autosave *autosave = (Autosave *)arg;
+
+    mutex_lock(autosave->lock);
+    for(;;){
+        // The last autosave is still written when the thread is stopped.
+        while(!autosave->job && !autosave->stop) condition_wait(autosave->wake,autosave->lock);
+        AutosaveJob *job = autosave->job;
+        if(!job) break;
+        mutex_unlock(autosave->lock);
+
+        write_job(autosave,job);
+        free_job(job);
+
+        mutex_lock(autosave->lock);
+        autosave->job = NULL;
+    }
+    mutex_unlock(autosave->lock);
+}
+
+Autosave *autosave(const char *path)
+{
+    Autosave *autosave = calloc(1,sizeof(Autosave));
+    char *pathCopy = malloc(strlen(path) + 1);
+    if(!autosave || !pathCopy){
+        fprintf(stderr, "Error: failed to allocate memory for autosave.\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(pathCopy,path);
+    autosave->path = pathCopy;
+    autosave->lock = mutex();
+    autosave->wake = condition();
+    autosave->thread = thread_start(autosave_worker,autosave);
+    if(!autosave->thread){
+        fprintf(stderr, "Warning: failed to start the autosave thread, the canvas won't be autosaved.\n");
+        free_condition(autosave->wake);
+        free_mutex(autosave->lock);
+        free(autosave->path);
+        free(autosave);
+        return NULL;
+    }
+    return autosave;
+}
+
+bool autosave_canvas(Autosave *autosave, CanvasShadow *canvas)
+{
+    mutex_lock(autosave->lock);
+    bool busy = autosave->job != NULL;
+    mutex_unlock(autosave->lock);
+    if(busy) return false;
+
+    sync_shadow(canvas);
+    int width = canvas->image.width;
+    int height = canvas->image.height;
+    Rectangle region = take_unsaved_damage(canvas);
+    bool full = !autosave->started || width != autosave->canvas_width || height != autosave->canvas_height;
+    if(full) region = (Rectangle){0,0,width,height};
+    if(region.width <= 0 || region.height <= 0 || width <= 0 || height <= 0) return true;
+
+    int firstColumn = (int)floorf(region.x) / AUTOSAVE_TILE_SIZE;
+    int firstRow = (int)floorf(region.y) / AUTOSAVE_TILE_SIZE;
+    int lastColumn = ((int)ceilf(region.x + region.width) - 1) / AUTOSAVE_TILE_SIZE;
+    int lastRow = ((int)ceilf(region.y + region.height) - 1) / AUTOSAVE_TILE_SIZE;
+    int tileCount = (lastColumn - firstColumn + 1) * (lastRow - firstRow + 1);
+
+    AutosaveJob *job = malloc(sizeof(AutosaveJob));
+    size_t pixelCount = (size_t)tileCount * AUTOSAVE_TILE_SIZE * AUTOSAVE_TILE_SIZE;
+    if(job){
+        job->tiles = malloc(tileCount * sizeof(TileCopy));
+        job->pixels = malloc(pixelCount * sizeof(Color));
+    }
+    if(!job || !job->tiles || !job->pixels){
+        fprintf(stderr, "Warning: failed to allocate memory to autosave the canvas.\n");
+        if(job){
+            free(job->tiles);
+            free(job->pixels);
+            free(job);
+        }
+        // The damage taken is lost, so the next autosave copies the whole canvas.
+        autosave->started = false;
+        return true;
+    }
+    job->width = width;
+    job->height = height;
+    job->full = full;
+    job->tile_count = 0;
+
+    size_t offset = 0;
+    for(int row = firstRow; row <= lastRow; row++){
+        for(int column = firstColumn; column <= lastColumn; column++){
+            int x = column * AUTOSAVE_TILE_SIZE;
+            int y = row * AUTOSAVE_TILE_SIZE;
+            int tileWidth = width - x < AUTOSAVE_TILE_SIZE ? width - x : AUTOSAVE_TILE_SIZE;
+            int tileHeight = height - y < AUTOSAVE_TILE_SIZE ? height - y : AUTOSAVE_TILE_SIZE;
+            for(int line = 0; line < tileHeight; line++)
+                memcpy(job->pixels + offset + (size_t)line * tileWidth,get_shadow_row(canvas,y + line) + x,tileWidth * sizeof(Color));
+            job->tiles[job->tile_count++] = (TileCopy){column,row,tileWidth,tileHeight,offset};
+            offset += (size_t)tileWidth * tileHeight;
+        }
+    }
+
+    mutex_lock(autosave->lock);
+    autosave->job = job;
+    condition_signal(autosave->wake);
+    mutex_unlock(autosave->lock);
+
+    autosave->started = true;
+    autosave->canvas_width = width;
+    autosave->canvas_height = height;
+    return true;
+}
+
+// RECOVERY
+
+// Unpacks the tiles of the records in [start, end) into pixels, whose rows are bottom-up. The records were checked already.
+static bool apply_batch(const unsigned char *bytes, size_t start, size_t end, Color *pixels, int width, int height, int tileSize, Color *tile)
+{
+    for(size_t position = start; position < end;){
+        int column = get_u16(bytes + position + 4);
+        int row = get_u16(bytes + position + 6);
+        int tileWidth = get_u16(bytes + position + 8);
+        int tileHeight = get_u16(bytes + position + 10);
+        uint32_t size = get_u32(bytes + position + 12);
+        if(!unpack_pixels(bytes + position + TILE_RECORD_SIZE,size,tile,tileWidth * tileHeight)) return false;
+        for(int line = 0; line < tileHeight; line++){
+            int y = row * tileSize + line;
+            memcpy(pixels + (size_t)(height - 1 - y) * width + column * tileSize,tile + (size_t)line * tileWidth,tileWidth * sizeof(Color));
+        }
+        position += TILE_RECORD_SIZE + size;
+    }
+    return true;
+}
+
+Image load_recovery(const char *path)
+{
+    Image image = {0};
+    FILE *file = fopen(path,"rb");
+    if(!file) return image;
+    unsigned char *bytes = NULL;
+    long length = -1;
+    if(fseek(file,0,SEEK_END) == 0) length = ftell(file);
+    if(length >= RECOVERY_HEADER_SIZE && fseek(file,0,SEEK_SET) == 0){
+        bytes = malloc(length);
+        if(bytes && fread(bytes,1,length,file) != (size_t)length){
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+    fclose(file);
+    if(!bytes) return image;
+    size_t size = (size_t)length;
+
+    uint32_t width = get_u32(bytes + 8);
+    uint32_t height = get_u32(bytes + 12);
+    uint32_t tileSize = get_u32(bytes + 16);
+    Color *pixels = NULL;
+    Color *tile = NULL;
+    if(memcmp(bytes,"CPRC",4) == 0 && get_u32(bytes + 4) == RECOVERY_VERSION && width > 0 && height > 0
+       && width <= 65535 * tileSize && height <= 65535 * tileSize && tileSize > 0 && tileSize <= 1024){
+        pixels = calloc((size_t)width * height,sizeof(Color));
+        tile = malloc((size_t)tileSize * tileSize * sizeof(Color));
+    }
+    if(!pixels || !tile){
+        free(pixels);
+        free(tile);
+        free(bytes);
+        return image;
+    }
+
+    // Records are read up to the first one that is cut short or malformed, the tiles of a batch are only used once its commit record is read.
+    bool recovered = false;
+    size_t position = RECOVERY_HEADER_SIZE;
+    size_t batchStart = position;
+    uint32_t pending = 0;
+    while(position + 4 <= size){
+        if(memcmp(bytes + position,"TILE",4) == 0){
+            if(position + TILE_RECORD_SIZE > size) break;
+            uint32_t column = get_u16(bytes + position + 4);
+            uint32_t row = get_u16(bytes + position + 6);
+            uint32_t tileWidth = get_u16(bytes + position + 8);
+            uint32_t tileHeight = get_u16(bytes + position + 10);
+            uint32_t packedSize = get_u32(bytes + position + 12);
+            if(tileWidth == 0 || tileHeight == 0 || tileWidth > tileSize || tileHeight > tileSize
+               || column * tileSize + tileWidth > width || row * tileSize + tileHeight > height
+               || packedSize > size - position - TILE_RECORD_SIZE) break;
+            position += TILE_RECORD_SIZE + packedSize;
+            pending++;
+        }
+        else if(memcmp(bytes + position,"DONE",4) == 0){
+            if(position + COMMIT_RECORD_SIZE > size || get_u32(bytes + position + 4) != pending) break;
+            if(!apply_batch(bytes,batchStart,position,pixels,width,height,tileSize,tile)) break;
+            recovered = true;
+            position += COMMIT_RECORD_SIZE;
+            batchStart = position;
+            pending = 0;
+        }
+        else break;
+    }
+    free(tile);
+    free(bytes);
+    if(!recovered){
+        free(pixels);
+        return image;
+    }
+    image.data = pixels;
+    image.width = width;
+    image.height = height;
+    image.mipmaps = 1;
+    image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    return image;
+}
+
+void free_autosave(Autosave *autosave)
+{
+    mutex_lock(autosave->lock);
+    autosave->stop = true;
+    condition_signal(autosave->wake);
+    mutex_unlock(autosave->lock);
+    thread_join(autosave->thread);
+
+    if(autosave->file) fclose(autosave->file);
+    // Closing cleanly leaves nothing to recover.
+    remove(autosave->path);
+    free_saved_tiles(autosave);
+    free_condition(autosave->wake);
+    free_mutex(autosave->lock);
+    free(autosave->path);
+    free(autosave);
+}
@@ -0,0 +1,40 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+#include "shadow.h"
+
+// Name of the file, next to the executable, that the canvas is autosaved into until the program closes cleanly.
+#define AUTOSAVE_FILE_NAME "c-paint.recovery"
+
+// Seconds between two autosaves, when no other interval is set.
+#define DEFAULT_AUTOSAVE_INTERVAL 30
+
+// Side, in pixels, of the square tiles the canvas is autosaved in.
+#define AUTOSAVE_TILE_SIZE 64
+
+// Keeps a recovery file with the canvas up to date from a background thread.
+// The file is a journal: a header with the size of the canvas followed by batches of run-length packed tiles, each one
+// closed by a commit record. Every autosave appends only the tiles that changed since the last one, and once the
+// journal grows a few times larger than the tiles it describes it's rewritten with their latest version only.
+// A batch cut short by a crash has no commit record, so recovering ignores it.
+typedef struct s_autosave Autosave;
+
+// Creates an autosave writing into the file at path and starts its thread. The file isn't touched before the first autosave.
+// Returns NULL if the thread couldn't be started.
+Autosave *autosave(const char *path);
+
+// Function that copies the tiles of canvas damaged since the last autosave and hands them to the thread, which writes the
+// ones that really changed. The first autosave, and the first after the canvas is resized, copies the whole canvas.
+// Returns false, taking nothing, while the last autosave is still being written.
+bool autosave_canvas(Autosave *autosave, CanvasShadow *canvas);
+
+// Returns the canvas stored in the recovery file at path, 8 bit RGBA with rows bottom-up like the canvas shadow.
+// Its data is NULL if nothing could be recovered.
+Image load_recovery(const char *path);
+
+// Function that waits for the last autosave, stops the thread, removes the recovery file and frees the memory of the autosave.
+void free_autosave(Autosave *autosave);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/raylib.h"
+#include "../fill.h"
+#include "timer.h"
+
+// Times the bucket fill of an all-white canvas against the per-pixel fill it replaced, and checks both fill the same pixels.
+// Run with "make bench-fill".
+
+#define RUNS 5
+
+static bool same_color(Color a, Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// The fill main.c used before fill.c: every matching neighbour is malloc'd, pushed on a width*height stack and marked
+// in a visited array. pixels are bottom-up and (x, y) top-down, like it read them from the render texture.
+static void per_pixel_fill(Color *pixels, int width, int height, int x, int y, Color new_color)
+{
+    Color initial_color = pixels[(height - y - 1) * width + x];
+    if(same_color(initial_color,new_color)) return;
+
+    Vector2 *open = malloc((size_t)width * height * sizeof(Vector2));
+    bool *visited = calloc((size_t)width * height, sizeof(bool));
+    if(!open || !visited){
+        fprintf(stderr, "Error: failed to allocate memory for the per-pixel fill.\n");
+        exit(EXIT_FAILURE);
+    }
+    int top = 0;
+    open[top++] = (Vector2){x,y};
+    visited[y * width + x] = true;
+
+    while(top > 0){
+        Vector2 current = open[--top];
+        pixels[(height - (int)current.y - 1) * width + (int)current.x] = new_color;
+        Vector2 adjacent[4] = {
+            {current.x - 1,current.y},
+            {current.x + 1,current.y},
+            {current.x,current.y - 1},
+            {current.x,current.y + 1}
+        };
+        for(int i = 0; i < 4; i++){
+            int ax = (int)adjacent[i].x;
+            int ay = (int)adjacent[i].y;
+            if(ax < 0 || ay < 0 || ax >= width || ay >= height) continue;
+            if(!same_color(pixels[(height - ay - 1) * width + ax],initial_color)) continue;
+            Vector2 *copy = malloc(sizeof(Vector2));
+            if(!copy) exit(EXIT_FAILURE);
+            *copy = adjacent[i];
+            if(!visited[(int)copy->y * width + (int)copy->x]){
+                open[top++] = *copy;
+                visited[(int)copy->y * width + (int)copy->x] = true;
+            }
+            free(copy);
+        }
+    }
+    free(open);
+    free(visited);
+}
+
+static Color *white_canvas(int width, int height)
+{
+    Color *pixels = malloc((size_t)width * height * sizeof(Color));
+    if(!pixels){
+        fprintf(stderr, "Error: failed to allocate memory for the canvas.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(size_t i = 0; i < (size_t)width * height; i++) pixels[i] = WHITE;
+    return pixels;
+}
+
+int main(void)
+{
+    const int sizes[][2] = {{1920,1080},{3840,2160}};
+    bool matched = true;
+
+    printf("%-11s %15s %15s %9s\n","canvas","per-pixel (ms)","span fill (ms)","speedup");
+    for(int s = 0; s < 2; s++){
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        Color *expected = white_canvas(width,height);
+        Color *pixels = white_canvas(width,height);
+
+        // The per-pixel fill takes seconds at 4K, it's only run once.
+        double start = benchmark_time();
+        per_pixel_fill(expected,width,height,width / 2,height / 2,RED);
+        double perPixel = benchmark_time() - start;
+
+        double best = 0;
+        for(int run = 0; run < RUNS; run++){
+            for(size_t i = 0; i < (size_t)width * height; i++) pixels[i] = WHITE;
+            start = benchmark_time();
+            flood_fill(pixels,width,height,width / 2,height / 2,RED,0,NULL);
+            double elapsed = benchmark_time() - start;
+            if(run == 0 || elapsed < best) best = elapsed;
+        }
+        if(memcmp(pixels,expected,(size_t)width * height * sizeof(Color)) != 0){
+            fprintf(stderr, "Error: the fills differ at %dx%d.\n",width,height);
+            matched = false;
+        }
+
+        printf("%4dx%-6d %15.1f %15.1f %8.0fx\n",width,height,perPixel * 1000,best * 1000,perPixel / best);
+        free(expected);
+        free(pixels);
+    }
+    return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/raylib.h"
+#include "../imagewriter.h"
+#include "../pngwriter.h"
+#include "timer.h"
+
+// Times raylib's ExportImage against write_png at every level on a painted canvas at 1080p, 4K and 8K, and checks the
+// PNGs written load back to the same pixels.
+// Run with "make bench-png".
+
+#define RUNS 3
+#define OUTPUT_PATH "png_benchmark.png"
+
+// Returns the size in bytes of the file at path, -1 if it can't be read.
+static long file_size(const char *path)
+{
+    FILE *file = fopen(path,"rb");
+    if(!file) return -1;
+    fseek(file,0,SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static void fill_circle(Color *pixels, int width, int height, int cx, int cy, int radius, Color color)
+{
+    for(int y = cy - radius; y <= cy + radius; y++){
+        if(y < 0 || y >= height) continue;
+        for(int x = cx - radius; x <= cx + radius; x++){
+            if(x < 0 || x >= width) continue;
+            if((x - cx) * (x - cx) + (y - cy) * (y - cy) <= radius * radius) pixels[(size_t)y * width + x] = color;
+        }
+    }
+}
+
+// Returns a canvas that looks like flat artwork: a white page with a shaded band and overlapping dabs of color,
+// drawn from a fixed seed so every run compresses the same pixels.
+static Color *painted_canvas(int width, int height)
+{
+    Color *pixels = malloc((size_t)width * height * sizeof(Color));
+    if(!pixels){
+        fprintf(stderr, "Error: failed to allocate memory for the canvas.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            Color color = WHITE;
+            if(y > height / 3 && y < height / 2) color = (Color){60 + 120 * x / width,90,200 - 100 * y / height,255};
+            pixels[(size_t)y * width + x] = color;
+        }
+    }
+    srand(1);
+    for(int i = 0; i < 400; i++){
+        Color color = {rand() % 256,rand() % 256,rand() % 256,255};
+        int radius = (1 + rand() % 40) * width / 1920;
+        fill_circle(pixels,width,height,rand() % width,rand() % height,radius,color);
+    }
+    return pixels;
+}
+
+// Returns true if the PNG at path loads back to the width * height pixels given.
+static bool loads_back(const char *path, const Color *pixels, int width, int height)
+{
+    Image loaded = LoadImage(path);
+    bool same = loaded.data != NULL && loaded.width == width && loaded.height == height &&
+                loaded.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 &&
+                memcmp(loaded.data,pixels,(size_t)width * height * sizeof(Color)) == 0;
+    UnloadImage(loaded);
+    return same;
+}
+
+int main(void)
+{
+    const int sizes[][2] = {{1920,1080},{3840,2160},{7680,4320}};
+    const char *levelNames[] = {"FAST","BALANCED","SMALL"};
+    bool matched = true;
+
+    SetTraceLogLevel(LOG_WARNING);
+    printf("%-11s %20s %20s %20s %20s\n","canvas","ExportImage","write_png FAST","write_png BALANCED","write_png SMALL");
+    printf("%-11s %20s %20s %20s %20s\n","","ms / KB","ms / KB","ms / KB","ms / KB");
+    for(int s = 0; s < 3; s++){
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        Color *pixels = painted_canvas(width,height);
+        Image image = {pixels,width,height,1,PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+        ImageRows rows = image_rows(image,false);
+
+        // ExportImage takes seconds at 8K, it's only run once.
+        double start = benchmark_time();
+        if(!ExportImage(image,OUTPUT_PATH)){
+            fprintf(stderr, "Error: ExportImage failed at %dx%d.\n",width,height);
+            exit(EXIT_FAILURE);
+        }
+        double exported = benchmark_time() - start;
+        long exportedSize = file_size(OUTPUT_PATH);
+        printf("%4dx%-6d %12.1f / %5ld",width,height,exported * 1000,exportedSize / 1024);
+
+        for(int level = PNG_FAST; level <= PNG_SMALL; level++){
+            double best = 0;
+            for(int run = 0; run < RUNS; run++){
+                start = benchmark_time();
+                if(!write_png(OUTPUT_PATH,&rows,level,NULL,NULL)){
+                    fprintf(stderr, "Error: write_png failed at %dx%d.\n",width,height);
+                    exit(EXIT_FAILURE);
+                }
+                double elapsed = benchmark_time() - start;
+                if(run == 0 || elapsed < best) best = elapsed;
+            }
+            printf(" %12.1f / %5ld",best * 1000,file_size(OUTPUT_PATH) / 1024);
+            fflush(stdout);
+            if(!loads_back(OUTPUT_PATH,pixels,width,height)){
+                fprintf(stderr, "\nError: the %s PNG at %dx%d doesn't load back to the canvas.\n",levelNames[level],width,height);
+                matched = false;
+            }
+        }
+        printf("\n");
+        free(pixels);
+    }
+    remove(OUTPUT_PATH);
+    return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
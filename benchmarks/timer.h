@@ -0,0 +1,9 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// Wall clock for the benchmarks. It lives in its own file because windows.h clashes with raylib.h.
+
+// Returns the time, in seconds, from a monotonic clock with an arbitrary start.
+double benchmark_time(void);
+
+#endif
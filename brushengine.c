@@ -0,0 +1,50 @@
+#include "brushengine.h"
+#include <stddef.h>
+#include <math.h>
+
+void begin_dab_stroke(DabStroke *stroke)
+{
+    stroke->leftover = 0.0f;
+    stroke->active = false;
+}
+
+void stroke_to(DabStroke *stroke, Dab point, float diameter, float spacing, DabFunc dab, SweepFunc sweep, void *data)
+{
+    if(!stroke->active){
+        dab(point,data);
+        stroke->last = point;
+        stroke->leftover = 0.0f;
+        stroke->active = true;
+        return;
+    }
+
+    Dab last = stroke->last;
+    float dx = point.position.x - last.position.x;
+    float dy = point.position.y - last.position.y;
+    float distance = sqrtf(dx * dx + dy * dy);
+    if(distance == 0.0f) return;
+
+    if(spacing <= 0.0f && sweep != NULL){
+        sweep(last,point,data);
+        stroke->last = point;
+        return;
+    }
+
+    float step = spacing * diameter * (last.scale < point.scale ? last.scale : point.scale);
+    if(step < 1.0f) step = 1.0f;
+
+    // The first dab goes where the previous segment left off, so the spacing is the same across frames.
+    float position = step - stroke->leftover;
+    // The step shrinks when the dabs get smaller, the leftover of the longer step is already past it.
+    if(position < 0.0f) position = 0.0f;
+    for(; position <= distance; position += step){
+        float t = position / distance;
+        dab((Dab){
+            {last.position.x + t * dx, last.position.y + t * dy},
+            last.scale + t * (point.scale - last.scale),
+            last.opacity + t * (point.opacity - last.opacity)
+        },data);
+    }
+    stroke->leftover = distance - (position - step);
+    stroke->last = point;
+}
@@ -0,0 +1,45 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Default distance between dabs, as a fraction of the brush diameter.
+#define DEFAULT_DAB_SPACING 0.1f
+
+// Definition of a Dab, a point of the stroke: where the brush is stamped, its size relative to the brush's
+// and its opacity (0-1), which pen pressure or the speed of the stroke can change from one point to the next.
+typedef struct s_dab
+{
+    Vector2 position;
+    float scale;
+    float opacity;
+
+} Dab;
+
+// Definition of a DabStroke that places the dabs of a stroke, a copy of the brush stamped along the mouse path.
+// leftover is the distance traveled since the last dab, which carries over to the next frame.
+typedef struct s_dabstroke
+{
+    Dab last;
+    float leftover;
+    bool active;
+
+} DabStroke;
+
+// Function called with every dab.
+typedef void (*DabFunc)(Dab dab, void *data);
+
+// Function called to draw the whole segment from start to end at once.
+typedef void (*SweepFunc)(Dab start, Dab end, void *data);
+
+// Function that starts a new stroke, the next point given to stroke_to() places its first dab.
+void begin_dab_stroke(DabStroke *stroke);
+
+// Function that moves the stroke to point. The first call after begin_dab_stroke() places a dab at point,
+// the next ones place a dab every spacing * diameter pixels (at least one pixel) along the way, at the smaller scale of
+// the two ends. The scale and opacity of the dabs go linearly from the last point to this one.
+// With a spacing of 0 the segment from the last point is passed to sweep instead, when it isn't NULL.
+void stroke_to(DabStroke *stroke, Dab point, float diameter, float spacing, DabFunc dab, SweepFunc sweep, void *data);
+
+#endif
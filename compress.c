@@ -0,0 +1,79 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLOCK_LENGTH 0x8000
+#define RUN_FLAG 0x8000
+
+static unsigned char *write_header(unsigned char *out, unsigned int header)
+{
+    out[0] = header & 0xFF;
+    out[1] = header >> 8;
+    return out + 2;
+}
+
+unsigned char *pack_pixels(const Color *pixels, int count, size_t *packedSize)
+{
+    // Worst case, no two neighbouring pixels are equal and every block is a literal of MAX_BLOCK_LENGTH pixels.
+    size_t capacity = (size_t)count * sizeof(Color) + ((size_t)count / MAX_BLOCK_LENGTH + 1) * 2;
+    unsigned char *packed = malloc(capacity);
+    if(!packed) return NULL;
+
+    const unsigned int *values = (const unsigned int *)pixels;
+    unsigned char *out = packed;
+    int i = 0;
+
+    while(i < count){
+        int run = 1;
+        while(i + run < count && run < MAX_BLOCK_LENGTH && values[i + run] == values[i]) run++;
+
+        if(run > 1){
+            out = write_header(out, RUN_FLAG | (run - 1));
+            memcpy(out, &values[i], sizeof(Color));
+            out += sizeof(Color);
+            i += run;
+            continue;
+        }
+
+        // Literal block, it ends where a run of at least two equal pixels starts.
+        int length = 1;
+        while(i + length < count && length < MAX_BLOCK_LENGTH
+              && !(i + length + 1 < count && values[i + length] == values[i + length + 1])) length++;
+        out = write_header(out, length - 1);
+        memcpy(out, &values[i], length * sizeof(Color));
+        out += length * sizeof(Color);
+        i += length;
+    }
+
+    *packedSize = out - packed;
+    unsigned char *shrunk = realloc(packed, *packedSize ? *packedSize : 1);
+    return shrunk ? shrunk : packed;
+}
+
+bool unpack_pixels(const unsigned char *packed, size_t packedSize, Color *pixels, int count)
+{
+    const unsigned char *end = packed + packedSize;
+    int i = 0;
+
+    while(packed + 2 <= end){
+        unsigned int header = packed[0] | (packed[1] << 8);
+        int length = (header & ~RUN_FLAG) + 1;
+        packed += 2;
+        if(i + length > count) return false;
+
+        if(header & RUN_FLAG){
+            if(packed + sizeof(Color) > end) return false;
+            Color color;
+            memcpy(&color, packed, sizeof(Color));
+            for(int j = 0; j < length; j++) pixels[i + j] = color;
+            packed += sizeof(Color);
+        }
+        else{
+            if(packed + length * sizeof(Color) > end) return false;
+            memcpy(&pixels[i], packed, length * sizeof(Color));
+            packed += length * sizeof(Color);
+        }
+        i += length;
+    }
+    return i == count && packed == end;
+}
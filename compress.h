@@ -0,0 +1,19 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Run-length encoding of pixels, fast to pack and unpack and very effective on the flat colors of a painting.
+// Packed data is a sequence of 16 bit headers: with the high bit set the next pixel repeats (header & 0x7FFF) + 1 times,
+// otherwise (header + 1) pixels follow as they are.
+
+// Compresses count pixels and returns a malloc'd buffer with the packed data, writing its size into packedSize.
+// Returns NULL if memory couldn't be allocated.
+unsigned char *pack_pixels(const Color *pixels, int count, size_t *packedSize);
+
+// Decompresses packed into pixels, which must have room for count pixels. Returns false if packed is malformed.
+bool unpack_pixels(const unsigned char *packed, size_t packedSize, Color *pixels, int count);
+
+#endif
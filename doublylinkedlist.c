@@ -1,9 +1,205 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <string.h>
+#include <math.h>
 #include "doublylinkedlist.h"
+#include "compress.h"
+#include "threads.h"
 #include "include/raylib.h"
 
+// Tile pixels start raw and are replaced by their packed version once the worker compresses them.
+// They never change after being created, so the worker can read raw without holding the lock;
+// only the swap from raw to packed and the reference count are protected by it.
+struct s_tiledata
+{
+    Color *raw;
+    unsigned char *packed;
+    size_t packed_size;
+    int count;
+    size_t bytes;
+    int references;
+    TileData *next_job;
+};
+
+struct s_historyworker
+{
+    Thread *thread;
+    Mutex *lock;
+    Condition *wake;
+    TileData *first_job;
+    TileData *last_job;
+    bool stop;
+};
+
+// Scratch buffers used to unpack a tile and to pack it before uploading it to the GPU.
+static Color unpackBuffer[HISTORY_TILE_SIZE * HISTORY_TILE_SIZE];
+static Color uploadBuffer[HISTORY_TILE_SIZE * HISTORY_TILE_SIZE];
+
+// Drops one reference to data, freeing it with the last one. Must be called with the worker's lock held.
+static void release_tile_data(TileData *data)
+{
+    if(--data->references > 0) return;
+    free(data->raw);
+    free(data->packed);
+    free(data);
+}
+
+static void history_worker(void *arg)
+{
+    DoublyLinkedList *list = (DoublyLinkedList *)arg;
+    HistoryWorker *worker = list->worker;
+
+    mutex_lock(worker->lock);
+    while(!worker->stop){
+        TileData *data = worker->first_job;
+        if(!data){
+            condition_wait(worker->wake,worker->lock);
+            continue;
+        }
+        worker->first_job = data->next_job;
+        if(!worker->first_job) worker->last_job = NULL;
+
+        // Only the job holds it, the tile was erased before it got compressed.
+        if(data->references == 1){
+            release_tile_data(data);
+            continue;
+        }
+
+        mutex_unlock(worker->lock);
+        size_t packedSize;
+        unsigned char *packed = pack_pixels(data->raw,data->count,&packedSize);
+        mutex_lock(worker->lock);
+
+        if(packed && data->references > 1 && packedSize < data->count * sizeof(Color)){
+            list->used_bytes -= data->bytes;
+            free(data->raw);
+            data->raw = NULL;
+            data->packed = packed;
+            data->packed_size = packedSize;
+            data->bytes = sizeof(TileData) + packedSize;
+            list->used_bytes += data->bytes;
+        }
+        else{
+            free(packed);
+        }
+        release_tile_data(data);
+    }
+    mutex_unlock(worker->lock);
+}
+
+static HistoryWorker *history_worker_start(DoublyLinkedList *list)
+{
+    HistoryWorker *worker = malloc(sizeof(HistoryWorker));
+    if(!worker){
+        fprintf(stderr, "Error: failed to allocate memory for history worker.\n");
+        exit(EXIT_FAILURE);
+    }
+    worker->lock = mutex();
+    worker->wake = condition();
+    worker->first_job = NULL;
+    worker->last_job = NULL;
+    worker->stop = false;
+    list->worker = worker;
+    worker->thread = thread_start(history_worker,list);
+    if(!worker->thread){
+        fprintf(stderr, "Warning: failed to start history worker, undo steps won't be compressed.\n");
+    }
+    return worker;
+}
+
+static void history_worker_stop(HistoryWorker *worker)
+{
+    mutex_lock(worker->lock);
+    worker->stop = true;
+    condition_signal(worker->wake);
+    mutex_unlock(worker->lock);
+    if(worker->thread) thread_join(worker->thread);
+
+    while(worker->first_job){
+        TileData *data = worker->first_job;
+        worker->first_job = data->next_job;
+        release_tile_data(data);
+    }
+    free_condition(worker->wake);
+    free_mutex(worker->lock);
+    free(worker);
+}
+
+// Creates tile data with room for count raw pixels, which must be filled before queue_tile_data() is called.
+static TileData *tile_data(int count)
+{
+    TileData *data = malloc(sizeof(TileData));
+    Color *raw = malloc(sizeof(Color) * count);
+    if(!data || !raw){
+        fprintf(stderr, "Error: failed to allocate memory for history tile.\n");
+        exit(EXIT_FAILURE);
+    }
+    data->raw = raw;
+    data->packed = NULL;
+    data->packed_size = 0;
+    data->count = count;
+    data->bytes = sizeof(TileData) + sizeof(Color) * count;
+    data->next_job = NULL;
+    return data;
+}
+
+// Adds data to the memory used by the history and queues it to be compressed.
+static TileData *queue_tile_data(DoublyLinkedList *list, TileData *data)
+{
+    HistoryWorker *worker = list->worker;
+    mutex_lock(worker->lock);
+    list->used_bytes += data->bytes;
+    data->references = 1;
+    if(worker->thread){
+        data->references++;
+        if(worker->last_job) worker->last_job->next_job = data;
+        else worker->first_job = data;
+        worker->last_job = data;
+        condition_signal(worker->wake);
+    }
+    mutex_unlock(worker->lock);
+    return data;
+}
+
+// Creates tile data holding a copy of width*height pixels read row by row with the given row pointers,
+// and queues it to be compressed.
+static TileData *tile_data_from_rows(DoublyLinkedList *list, Color *rows[], int width, int height)
+{
+    TileData *data = tile_data(width * height);
+    for(int row = 0; row < height; row++){
+        memcpy(&data->raw[row * width],rows[row],width * sizeof(Color));
+    }
+    return queue_tile_data(list,data);
+}
+
+// Copies the pixels of data into pixels, unpacking them if the worker already compressed them.
+static void read_tile_data(DoublyLinkedList *list, TileData *data, Color *pixels)
+{
+    mutex_lock(list->worker->lock);
+    if(data->raw){
+        memcpy(pixels,data->raw,data->count * sizeof(Color));
+    }
+    else if(!unpack_pixels(data->packed,data->packed_size,pixels,data->count)){
+        fprintf(stderr, "Error: corrupted history tile.\n");
+    }
+    mutex_unlock(list->worker->lock);
+}
+
+static void drop_tile_data(DoublyLinkedList *list, TileData *data)
+{
+    mutex_lock(list->worker->lock);
+    list->used_bytes -= data->bytes;
+    release_tile_data(data);
+    mutex_unlock(list->worker->lock);
+}
+
+static void add_used_bytes(DoublyLinkedList *list, long bytes)
+{
+    mutex_lock(list->worker->lock);
+    list->used_bytes += bytes;
+    mutex_unlock(list->worker->lock);
+}
+
 DoublyLinkedList *doublylinkedlist(void)
 {
     DoublyLinkedList *newList = malloc(sizeof(DoublyLinkedList));
@@ -14,9 +210,45 @@ DoublyLinkedList *doublylinkedlist(void)
     newList->current = NULL;
     newList->first = NULL;
     newList->index = 0;
+    newList->count = 0;
+    newList->committed = (Image){0};
+    newList->used_bytes = 0;
+    newList->max_bytes = DEFAULT_HISTORY_BUDGET;
+    newList->replay = NULL;
+    newList->steps_since_keyframe = 0;
+    history_worker_start(newList);
     return newList;
 }
 
+// Returns the pointer to the pixel of the canvas row y (top-down) at column x inside an image read back from a render texture.
+static Color *committed_pixel(Image *image, int x, int y)
+{
+    return (Color *)image->data + (size_t)(image->height - 1 - y) * image->width + x;
+}
+
+static void free_tiles(DoublyLinkedList *list, Node *node)
+{
+    for(int i = 0; i < node->tile_count; i++){
+        drop_tile_data(list,node->tiles[i].data);
+    }
+    size_t tileBytes = sizeof(Tile) * node->tile_count;
+    free(node->tiles);
+    node->tiles = NULL;
+    node->tile_count = 0;
+    add_used_bytes(list,-(long)tileBytes);
+    node->bytes -= tileBytes;
+}
+
+static void free_node(DoublyLinkedList *list, Node *node)
+{
+    free_tiles(list,node);
+    if(node->keyframe) drop_tile_data(list,node->keyframe);
+    free_command(node->command);
+    add_used_bytes(list,-(long)node->bytes);
+    list->count--;
+    free(node);
+}
+
 void free_next_node(DoublyLinkedList *list){
 
     if(!list|| !list->current ||!list->current->next) return;
@@ -25,15 +257,242 @@ void free_next_node(DoublyLinkedList *list){
     Node *nextNode;
     while(node != NULL){
         nextNode = node->next;
-        UnloadTexture(node->value);
-        free(node);
+        free_node(list,node);
         node = nextNode;
     }
     list->current->next = NULL;
 }
 
+// Returns a tile holding the whole of image, which is all a step that resizes the canvas keeps.
+static Tile whole_image_tile(DoublyLinkedList *list, Image *image)
+{
+    Color **rows = malloc(sizeof(Color *) * image->height);
+    if(!rows){
+        fprintf(stderr, "Error: failed to allocate memory for history tile.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(int row = 0; row < image->height; row++){
+        rows[row] = committed_pixel(image,0,row);
+    }
+    Tile tile = {0,0,image->width,image->height,tile_data_from_rows(list,rows,image->width,image->height)};
+    free(rows);
+    return tile;
+}
 
-void add_node(DoublyLinkedList *list,Texture2D value)
+static bool tile_changed(Image *canvasImage, Image *committed, int x, int y, int width, int height)
+{
+    for(int row = y; row < y + height; row++){
+        if(memcmp(committed_pixel(canvasImage,x,row),committed_pixel(committed,x,row),width * sizeof(Color)) != 0)
+            return true;
+    }
+    return false;
+}
+
+// Compares canvasImage against the committed copy tile by tile, storing the previous pixels of every changed tile
+// in node and bringing the committed copy up to date.
+static void store_changed_tiles(DoublyLinkedList *list, Node *node, Image *canvasImage, Rectangle damage)
+{
+    int capacity = 0;
+    Color *rows[HISTORY_TILE_SIZE];
+
+    // Only the tiles the damage touches can have changed.
+    int firstX = (int)damage.x / HISTORY_TILE_SIZE * HISTORY_TILE_SIZE;
+    int firstY = (int)damage.y / HISTORY_TILE_SIZE * HISTORY_TILE_SIZE;
+    int right = (int)ceilf(damage.x + damage.width);
+    int bottom = (int)ceilf(damage.y + damage.height);
+    if(right > canvasImage->width) right = canvasImage->width;
+    if(bottom > canvasImage->height) bottom = canvasImage->height;
+
+    for(int y = firstY; y < bottom; y += HISTORY_TILE_SIZE){
+        for(int x = firstX; x < right; x += HISTORY_TILE_SIZE){
+            int width = canvasImage->width - x < HISTORY_TILE_SIZE ? canvasImage->width - x : HISTORY_TILE_SIZE;
+            int height = canvasImage->height - y < HISTORY_TILE_SIZE ? canvasImage->height - y : HISTORY_TILE_SIZE;
+
+            if(!tile_changed(canvasImage,&list->committed,x,y,width,height)) continue;
+
+            if(node->tile_count >= capacity){
+                capacity = capacity ? capacity * 2 : 16;
+                Tile *newTiles = realloc(node->tiles,sizeof(Tile) * capacity);
+                if(!newTiles){
+                    fprintf(stderr, "Error: failed to reallocate memory for history tiles.\n");
+                    exit(EXIT_FAILURE);
+                }
+                node->tiles = newTiles;
+            }
+
+            for(int row = 0; row < height; row++){
+                rows[row] = committed_pixel(&list->committed,x,y + row);
+            }
+            Tile *tile = &node->tiles[node->tile_count++];
+            tile->x = x;
+            tile->y = y;
+            tile->width = width;
+            tile->height = height;
+            tile->data = tile_data_from_rows(list,rows,width,height);
+            node->bytes += sizeof(Tile);
+
+            for(int row = 0; row < height; row++){
+                memcpy(rows[row],committed_pixel(canvasImage,x,y + row),width * sizeof(Color));
+            }
+        }
+    }
+}
+
+// Swaps the whole canvas with the one kept by a resize step, reloading the canvas with the size of that one.
+static void swap_canvas(DoublyLinkedList *list, Node *node, CanvasShadow *canvas)
+{
+    Tile *tile = &node->tiles[0];
+    Image other = GenImageColor(tile->width,tile->height,BLANK);
+    Color *pixels = malloc(sizeof(Color) * tile->width * tile->height);
+    if(!pixels){
+        fprintf(stderr, "Error: failed to allocate memory to resize the canvas.\n");
+        exit(EXIT_FAILURE);
+    }
+    read_tile_data(list,tile->data,pixels);
+    for(int row = 0; row < tile->height; row++){
+        memcpy(committed_pixel(&other,0,row),&pixels[(size_t)row * tile->width],tile->width * sizeof(Color));
+    }
+    free(pixels);
+
+    drop_tile_data(list,tile->data);
+    *tile = whole_image_tile(list,&list->committed);
+    UnloadImage(list->committed);
+    list->committed = other;
+    load_shadow_pixels(canvas,other.data,other.width,other.height);
+}
+
+// Swaps the pixels of every tile of node with the committed copy and uploads the result to canvas.
+// The canvas always has the size it had when the tiles were stored, since resizes are undone too.
+static void swap_tiles(DoublyLinkedList *list, Node *node, CanvasShadow *canvas)
+{
+    if(node->resized){
+        swap_canvas(list,node,canvas);
+        return;
+    }
+
+    Image *committed = &list->committed;
+    // The CPU copy of the canvas gets the same pixels, unless it has to be read back anyway.
+    Image *shadow = !canvas->stale && canvas->image.width == committed->width && canvas->image.height == committed->height ? &canvas->image : NULL;
+    Color *rows[HISTORY_TILE_SIZE];
+
+    for(int i = 0; i < node->tile_count; i++){
+        Tile *tile = &node->tiles[i];
+        int width = tile->width;
+        int height = tile->height;
+
+        read_tile_data(list,tile->data,unpackBuffer);
+
+        for(int row = 0; row < height; row++){
+            memcpy(&uploadBuffer[row * width],committed_pixel(committed,tile->x,tile->y + row),width * sizeof(Color));
+            rows[row] = &uploadBuffer[row * width];
+        }
+        drop_tile_data(list,tile->data);
+        tile->data = tile_data_from_rows(list,rows,width,height);
+
+        for(int row = 0; row < height; row++){
+            Color *committedRow = committed_pixel(committed,tile->x,tile->y + row);
+            memcpy(committedRow,&unpackBuffer[row * tile->width],width * sizeof(Color));
+            if(shadow) memcpy(committed_pixel(shadow,tile->x,tile->y + row),committedRow,width * sizeof(Color));
+            // The texture stores rows bottom-up, so the last tile row goes first.
+            memcpy(&uploadBuffer[(height - 1 - row) * width],committedRow,width * sizeof(Color));
+        }
+        Rectangle rec = {tile->x,committed->height - tile->y - height,width,height};
+        UpdateTextureRec(canvas->target->texture,rec,uploadBuffer);
+        add_unsaved_damage(canvas,(Rectangle){tile->x,tile->y,width,height});
+    }
+}
+
+// Copies canvas into the committed copy, after it was drawn into by replaying commands.
+static void reload_committed(DoublyLinkedList *list, CanvasShadow *canvas)
+{
+    sync_shadow(canvas);
+    UnloadImage(list->committed);
+    list->committed = ImageCopy(canvas->image);
+    take_canvas_damage(canvas);
+}
+
+// Brings canvas to the state of target by restoring the closest keyframe before it and replaying the commands in between.
+static void replay_to(DoublyLinkedList *list, Node *target, CanvasShadow *canvas)
+{
+    Node *keyframeNode = target;
+    while(!keyframeNode->keyframe) keyframeNode = keyframeNode->previous;
+
+    // A keyframe has the size of its node, the canvas is brought back to it before replaying.
+    if(list->committed.width != keyframeNode->width || list->committed.height != keyframeNode->height){
+        UnloadImage(list->committed);
+        list->committed = GenImageColor(keyframeNode->width,keyframeNode->height,BLANK);
+    }
+    read_tile_data(list,keyframeNode->keyframe,list->committed.data);
+    load_shadow_pixels(canvas,list->committed.data,list->committed.width,list->committed.height);
+
+    for(Node *node = keyframeNode; node != target; ){
+        node = node->next;
+        list->replay(canvas,node->command);
+    }
+    reload_committed(list,canvas);
+}
+
+// Returns true if node can be replayed from the keyframe of an earlier node, given whether the node before it could.
+// Replaying never crosses a resize, whose step keeps the canvas it needs in its tile.
+static bool replays_from_keyframe(Node *node, bool anchored)
+{
+    return node->keyframe || (anchored && node->command && !node->resized);
+}
+
+// Returns true if some replay only node can't be reached anymore from a keyframe.
+static bool has_unanchored_node(DoublyLinkedList *list)
+{
+    bool anchored = list->first->keyframe != NULL;
+    for(Node *node = list->first->next; node; node = node->next){
+        if(node->replay_only && !anchored) return true;
+        anchored = replays_from_keyframe(node,anchored);
+    }
+    return false;
+}
+
+// Erases the tiles of the oldest steps that can be replayed from a keyframe, until the history fits in its budget.
+static void demote_nodes(DoublyLinkedList *list)
+{
+    if(!list->replay) return;
+
+    bool anchored = list->first->keyframe != NULL;
+    for(Node *node = list->first->next; node && get_history_usage(list) > list->max_bytes; node = node->next){
+        if(anchored && node->command && !node->resized && !node->replay_only){
+            free_tiles(list,node);
+            node->replay_only = true;
+        }
+        anchored = replays_from_keyframe(node,anchored);
+        if(node == list->current) break;
+    }
+}
+
+// Erases the oldest node, the current one is always kept so the canvas can still be restored.
+static bool erase_first_node(DoublyLinkedList *list)
+{
+    if(!list->first || list->first == list->current) return false;
+
+    Node *erasedFirstNode = list->first;
+    list->first = list->first->next;
+    list->first->previous = NULL;
+    // The first node can't be undone, so the pixels it kept are no longer needed.
+    free_tiles(list,list->first);
+    free_node(list,erasedFirstNode);
+    list->index--;
+    return true;
+}
+
+static void fit_in_budget(DoublyLinkedList *list)
+{
+    if(get_history_usage(list) <= list->max_bytes) return;
+
+    demote_nodes(list);
+    while(get_history_usage(list) > list->max_bytes && erase_first_node(list)){
+        // Replay only steps that depended on an erased keyframe go with it.
+        while(has_unanchored_node(list) && erase_first_node(list));
+    }
+}
+
+void add_node(DoublyLinkedList *list,CanvasShadow *canvas,Command *command)
 {
     Node *newNode = malloc(sizeof(Node));
 
@@ -42,65 +501,136 @@ void add_node(DoublyLinkedList *list,Texture2D value)
         exit(EXIT_FAILURE);
     }
 
-    Image tempImage = LoadImageFromTexture(value);
-    newNode->value = LoadTextureFromImage(tempImage);
-    UnloadImage(tempImage);
+    sync_shadow(canvas);
+    Image *canvasImage = &canvas->image;
+    Rectangle damage = take_canvas_damage(canvas);
+    newNode->tiles = NULL;
+    newNode->tile_count = 0;
+    newNode->replay_only = false;
+    newNode->keyframe = NULL;
+    newNode->width = canvasImage->width;
+    newNode->height = canvasImage->height;
+    newNode->resized = false;
+    newNode->bytes = sizeof(Node);
     newNode->next = NULL;
+    if(command && !command->replayable){
+        free_command(command);
+        command = NULL;
+    }
+    newNode->command = command;
+    if(command) newNode->bytes += command_bytes(command);
 
     if(!list->first)
     {
         newNode->previous = NULL;
         list->first = newNode;
+        list->committed = ImageCopy(*canvasImage);
     }
     else
     {
         if(list->current->next){
             free_next_node(list);
         }
+        if(canvasImage->width != list->committed.width || canvasImage->height != list->committed.height){
+            // The whole canvas from before is kept, so undoing brings back the pixels a shrink cut off.
+            newNode->tiles = malloc(sizeof(Tile));
+            if(!newNode->tiles){
+                fprintf(stderr, "Error: failed to allocate memory for history tiles.\n");
+                exit(EXIT_FAILURE);
+            }
+            newNode->tiles[0] = whole_image_tile(list,&list->committed);
+            newNode->tile_count = 1;
+            newNode->resized = true;
+            newNode->bytes += sizeof(Tile);
+            UnloadImage(list->committed);
+            list->committed = ImageCopy(*canvasImage);
+        }
+        else{
+            store_changed_tiles(list,newNode,canvasImage,damage);
+        }
         list->current->next = newNode;
         newNode->previous = list->current;
-        
+
     }
     list->current = newNode;
     list->index++;
-    if(list->index > 10){
-        list->index = 10;
-        Node *erasedFirstNode = list->first;
-        list->first = list->first->next;
-        list->first->previous = NULL;
-        UnloadTexture(erasedFirstNode->value);
-        free(erasedFirstNode);
+    list->count++;
+    add_used_bytes(list,newNode->bytes);
+
+    if(list->replay){
+        if(list->steps_since_keyframe == 0){
+            int count = list->committed.width * list->committed.height;
+            newNode->keyframe = tile_data(count);
+            memcpy(newNode->keyframe->raw,list->committed.data,count * sizeof(Color));
+            queue_tile_data(list,newNode->keyframe);
+        }
+        list->steps_since_keyframe = (list->steps_since_keyframe + 1) % KEYFRAME_INTERVAL;
     }
+    fit_in_budget(list);
 }
 
-void previous_node(DoublyLinkedList *list)
+void previous_node(DoublyLinkedList *list,CanvasShadow *canvas)
 {
     if(!list->current->previous) return;
 
+    if(list->current->replay_only)
+        replay_to(list,list->current->previous,canvas);
+    else{
+        swap_tiles(list,list->current,canvas);
+        take_canvas_damage(canvas);
+    }
     list->current = list->current->previous;
     list->index--;
 }
 
-void next_node(DoublyLinkedList *list)
+void next_node(DoublyLinkedList *list,CanvasShadow *canvas)
 {
     if(!list->current->next) return;
 
     list->current = list->current->next;
+    if(list->current->replay_only){
+        list->replay(canvas,list->current->command);
+        reload_committed(list,canvas);
+    }
+    else{
+        swap_tiles(list,list->current,canvas);
+        take_canvas_damage(canvas);
+    }
     list->index++;
 }
 
+void set_history_budget(DoublyLinkedList *list, size_t max_bytes)
+{
+    list->max_bytes = max_bytes;
+    fit_in_budget(list);
+}
+
+void set_replay_function(DoublyLinkedList *list, ReplayFunc replay)
+{
+    list->replay = replay;
+}
+
+size_t get_history_usage(DoublyLinkedList *list)
+{
+    mutex_lock(list->worker->lock);
+    size_t usedBytes = list->used_bytes;
+    mutex_unlock(list->worker->lock);
+    return usedBytes;
+}
+
 
 void free_list(DoublyLinkedList *list)
 {
-    if(!list || !list->first) return;
+    if(!list) return;
 
     Node *temp;
 
     while(list->first){
         temp = list->first;
         list->first = list->first->next;
-        UnloadTexture(temp->value);
-        free(temp);
+        free_node(list,temp);
     }
+    history_worker_stop(list->worker);
+    UnloadImage(list->committed);
     free(list);
-}
\ No newline at end of file
+}
@@ -1,22 +1,73 @@
 #include <stdio.h>
 #include "include/raylib.h"
+#include "shadow.h"
+#include "journal.h"
 
+// Side, in pixels, of the square tiles the canvas is split into when a step is stored.
+#define HISTORY_TILE_SIZE 64
 
-// Definition of a Node that stores Texture2D values, a pointer to the previous and next node.
+// Every KEYFRAME_INTERVAL steps a full copy of the canvas is kept, so steps that only keep their command can be replayed from it.
+#define KEYFRAME_INTERVAL 16
+
+// Memory the history may use before the oldest steps are erased, when no other budget is set.
+#define DEFAULT_HISTORY_BUDGET (256 * 1024 * 1024)
+
+// Pixels of a tile, kept in system memory and compressed in the background by the history worker.
+typedef struct s_tiledata TileData;
+
+// Compression worker shared by the nodes of a history.
+typedef struct s_historyworker HistoryWorker;
+
+// Definition of a Tile that stores the pixels of one canvas region changed by a step.
+// x and y are the top-left corner in canvas coordinates and pixels are stored top-down.
+// While the step is applied the tile holds the pixels from before it, once undone it holds the pixels after it.
+typedef struct s_tile
+{
+    int x;
+    int y;
+    int width;
+    int height;
+    TileData *data;
+
+} Tile;
+
+// Definition of a Node that stores the tiles changed by a step, a pointer to the previous and next node.
+// command, when the step can be replayed, records the operation of the step. Once the history runs out of memory
+// the tiles of such steps are erased and replay_only is set, undoing them restores the closest keyframe and replays the commands after it.
+// width and height are the size of the canvas once the step is applied. A step that resized the canvas has resized set
+// and a single tile holding the whole canvas at its other size.
 typedef struct s_node
 {
-    Texture2D value;
+    Tile *tiles;
+    int tile_count;
+    Command *command;
+    bool replay_only;
+    int width;
+    int height;
+    bool resized;
+    TileData *keyframe;
+    size_t bytes;
     struct s_node *previous;
     struct s_node *next;
 
 } Node;
 
 //Definition of a Doubly Linked List.
+//committed is a CPU copy of the canvas as it is at the current node, with rows bottom-up like render textures.
+//used_bytes is the memory taken by the nodes and max_bytes the budget they must fit in,
+//used_bytes shrinks as the worker compresses tiles so it is only accessed under the worker's lock.
 typedef struct s_doublylinkedlist
 {
     Node *current;
     Node *first;
     int index;
+    int count;
+    Image committed;
+    size_t used_bytes;
+    size_t max_bytes;
+    HistoryWorker *worker;
+    ReplayFunc replay;
+    int steps_since_keyframe;
 
 } DoublyLinkedList;
 
@@ -27,14 +78,24 @@ DoublyLinkedList *doublylinkedlist(void);
 // Function that frees memory of all the following nodes of the current one.
 void free_next_nodes(DoublyLinkedList *list);
 
-// Function that inserts a new value in the position next to the current node.
-void add_node(DoublyLinkedList *list,Texture2D canvas);
+// Function that inserts a new node, holding the tiles of canvas that changed since the current node, next to the current node.
+// The list takes ownership of command, which records the operation of the step and may be NULL if it can't be replayed.
+void add_node(DoublyLinkedList *list,CanvasShadow *canvas,Command *command);
+
+// Function that restores the tiles of the current node into canvas and sets the current node to the previous node.
+void previous_node(DoublyLinkedList *list,CanvasShadow *canvas);
+
+// Function that sets the current node to the next node and applies its tiles into canvas.
+void next_node(DoublyLinkedList *list,CanvasShadow *canvas);
+
+// Function that sets the function used to replay commands, without it steps always keep their tiles.
+void set_replay_function(DoublyLinkedList *list, ReplayFunc replay);
 
-// Function that sets the current node to the previous node.
-void previous_node(DoublyLinkedList *list);
+// Function that sets the memory budget of the history, erasing the oldest nodes until the history fits in it.
+void set_history_budget(DoublyLinkedList *list, size_t max_bytes);
 
-// Function that sets the current node to the next node.
-void next_node(DoublyLinkedList *list);
+// Function that returns the memory, in bytes, currently used by the nodes of the history.
+size_t get_history_usage(DoublyLinkedList *list);
 
-// Function that erases all nodes from the doubly linked list and frees the memory 
-void free_list(DoublyLinkedList *list);
\ No newline at end of file
+// Function that erases all nodes from the doubly linked list and frees the memory
+void free_list(DoublyLinkedList *list);
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "export.h"
+#include "threads.h"
+
+// state and progress are written by the export thread and read by the main thread, both under lock.
+// image, path, bottom_up and level are only touched by the export thread while it runs, png_level only by the main thread.
+struct s_imageexporter
+{
+    Thread *thread;
+    Mutex *lock;
+    Image image;
+    char *path;
+    bool bottom_up;
+    PngLevel level;
+    PngLevel png_level;
+    ExportState state;
+    float progress;
+};
+
+static void set_export_progress(ImageExporter *exporter, float progress)
+{
+    mutex_lock(exporter->lock);
+    exporter->progress = progress;
+    mutex_unlock(exporter->lock);
+}
+
+static void writer_progress(float progress, void *data)
+{
+    set_export_progress((ImageExporter *)data,progress);
+}
+
+static void export_worker(void *arg)
+{
+    ImageExporter *exporter = (ImageExporter *)arg;
+
+    // PNG, BMP, QOI and raw RGBA files are written from the rows as they are stored, only the formats left to raylib need the image flipped.
+    bool saved;
+    ImageRows rows = image_rows(exporter->image,exporter->bottom_up);
+    bool rgba = exporter->image.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    if(rgba && IsFileExtension(exporter->path,".png"))
+        saved = write_png(exporter->path,&rows,exporter->level,writer_progress,exporter);
+    else if(rgba && IsFileExtension(exporter->path,".bmp"))
+        saved = write_bmp(exporter->path,&rows,writer_progress,exporter);
+    else if(rgba && IsFileExtension(exporter->path,".qoi"))
+        saved = write_qoi(exporter->path,&rows,writer_progress,exporter);
+    else if(rgba && IsFileExtension(exporter->path,".rgba"))
+        saved = write_raw_rgba(exporter->path,&rows,writer_progress,exporter);
+    else{
+        if(exporter->bottom_up) ImageFlipVertical(&exporter->image);
+        saved = ExportImage(exporter->image,exporter->path);
+    }
+    if(!saved) fprintf(stderr, "Error: failed to export image to %s.\n",exporter->path);
+    UnloadImage(exporter->image);
+    exporter->image = (Image){0};
+
+    mutex_lock(exporter->lock);
+    exporter->state = saved ? EXPORT_DONE : EXPORT_FAILED;
+    exporter->progress = 1.0f;
+    mutex_unlock(exporter->lock);
+}
+
+ImageExporter *image_exporter(void)
+{
+    ImageExporter *exporter = calloc(1,sizeof(ImageExporter));
+    if(!exporter){
+        fprintf(stderr, "Error: failed to allocate memory for image exporter.\n");
+        exit(EXIT_FAILURE);
+    }
+    exporter->lock = mutex();
+    exporter->state = EXPORT_IDLE;
+    exporter->png_level = PNG_BALANCED;
+    return exporter;
+}
+
+bool start_export(ImageExporter *exporter, Image image, const char *path, bool bottom_up)
+{
+    if(exporter->thread != NULL) return false;
+
+    char *copy = malloc(strlen(path) + 1);
+    if(!copy) return false;
+    strcpy(copy,path);
+    free(exporter->path);
+    exporter->path = copy;
+    exporter->image = image;
+    exporter->bottom_up = bottom_up;
+    exporter->level = exporter->png_level;
+    exporter->state = EXPORT_RUNNING;
+    exporter->progress = 0.0f;
+
+    exporter->thread = thread_start(export_worker,exporter);
+    if(!exporter->thread){
+        exporter->image = (Image){0};
+        exporter->state = EXPORT_IDLE;
+        return false;
+    }
+    return true;
+}
+
+void set_export_png_level(ImageExporter *exporter, PngLevel level)
+{
+    exporter->png_level = level;
+}
+
+ExportState poll_export(ImageExporter *exporter, float *progress)
+{
+    mutex_lock(exporter->lock);
+    ExportState state = exporter->state;
+    if(progress) *progress = exporter->progress;
+    mutex_unlock(exporter->lock);
+
+    if(state == EXPORT_DONE || state == EXPORT_FAILED){
+        // The thread has nothing left to do once the state is set, so joining it doesn't block.
+        thread_join(exporter->thread);
+        exporter->thread = NULL;
+        exporter->state = EXPORT_IDLE;
+    }
+    return state;
+}
+
+void free_image_exporter(ImageExporter *exporter)
+{
+    if(exporter->thread) thread_join(exporter->thread);
+    free_mutex(exporter->lock);
+    free(exporter->path);
+    free(exporter);
+}
@@ -0,0 +1,42 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+#include "pngwriter.h"
+
+// Writes images to disk on a background thread, so the canvas can still be used while a large image is encoded.
+// Only one image is exported at a time. PNG files are written by write_png() on every core, BMP, QOI and raw RGBA
+// files by imagewriter.c and other formats by raylib.
+
+typedef enum
+{
+    EXPORT_IDLE = 0,
+    EXPORT_RUNNING,
+    EXPORT_DONE,
+    EXPORT_FAILED
+} ExportState;
+
+typedef struct s_imageexporter ImageExporter;
+
+// Creates an idle image exporter and returns a pointer to it.
+ImageExporter *image_exporter(void);
+
+// Function that starts writing image to path, with the format given by its extension, and returns true if it started.
+// On success the exporter takes ownership of image, which must be a copy the main thread won't touch again.
+// bottom_up tells that the rows of image are stored bottom-up, like render textures. Files written by this
+// program are written from them as they are, the formats left to raylib get the image flipped first.
+// Returns false, leaving image to the caller, if an export is already running or the thread can't be started.
+bool start_export(ImageExporter *exporter, Image image, const char *path, bool bottom_up);
+
+// Function that sets how hard the PNG files of the next exports are compressed.
+void set_export_png_level(ImageExporter *exporter, PngLevel level);
+
+// Returns the state of the export and sets progress, when it isn't NULL, to how much of it is done (0-1).
+// EXPORT_DONE or EXPORT_FAILED are returned once when the export finishes, after that the exporter is idle again.
+ExportState poll_export(ImageExporter *exporter, float *progress);
+
+// Function that waits for the running export to finish and frees the memory of the exporter.
+void free_image_exporter(ImageExporter *exporter);
+
+#endif
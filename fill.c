@@ -0,0 +1,212 @@
+#include "fill.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Values of the region mask: pixels that don't match the target color, that match it, and that were filled.
+#define OUTSIDE 0
+#define MATCHING 1
+#define FILLED 2
+
+// Definition of a Span of pixels [x1, x2] in row y to scan, it was reached from row y - dy.
+typedef struct s_span
+{
+    int x1;
+    int x2;
+    int y;
+    int dy;
+
+} Span;
+
+// Stack of spans with a fixed capacity. Spans pushed on a full stack are dropped and overflowed is set,
+// the pixels they would have reached are found again by seed_unfilled_neighbours().
+typedef struct s_spanstack
+{
+    Span *spans;
+    int top;
+    int capacity;
+    bool overflowed;
+
+} SpanStack;
+
+static void push_span(SpanStack *stack, int x1, int x2, int y, int dy)
+{
+    if(stack->top >= stack->capacity){
+        stack->overflowed = true;
+        return;
+    }
+    stack->spans[stack->top++] = (Span){x1, x2, y, dy};
+}
+
+static unsigned int color_value(Color color)
+{
+    unsigned int value;
+    memcpy(&value, &color, sizeof(value));
+    return value;
+}
+
+static bool channels_match(unsigned int value, unsigned int target, int tolerance)
+{
+    for(int shift = 0; shift < 32; shift += 8){
+        int difference = (int)((value >> shift) & 0xFF) - (int)((target >> shift) & 0xFF);
+        if(difference > tolerance || difference < -tolerance) return false;
+    }
+    return true;
+}
+
+// Writes MATCHING into mask for every pixel whose channels are all within tolerance of target, OUTSIDE for the others.
+static void match_pixels(const unsigned int *values, unsigned char *mask, size_t count, unsigned int target, int tolerance)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Four pixels at a time: the saturated differences in both directions give the absolute difference of every channel,
+    // and a pixel matches when none of its channels goes over the tolerance.
+    const __m128i targets = _mm_set1_epi32((int)target);
+    const __m128i tolerances = _mm_set1_epi8((char)tolerance);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(MATCHING);
+    for(; i + 16 <= count; i += 16){
+        __m128i matches[4];
+        for(int j = 0; j < 4; j++){
+            __m128i pixels = _mm_loadu_si128((const __m128i *)&values[i + j * 4]);
+            __m128i difference = _mm_or_si128(_mm_subs_epu8(pixels, targets), _mm_subs_epu8(targets, pixels));
+            matches[j] = _mm_cmpeq_epi32(_mm_subs_epu8(difference, tolerances), zero);
+        }
+        __m128i words = _mm_packs_epi32(matches[0], matches[1]);
+        __m128i words2 = _mm_packs_epi32(matches[2], matches[3]);
+        __m128i bytes = _mm_and_si128(_mm_packs_epi16(words, words2), ones);
+        _mm_storeu_si128((__m128i *)&mask[i], bytes);
+    }
+#endif
+    for(; i < count; i++){
+        mask[i] = channels_match(values[i], target, tolerance) ? MATCHING : OUTSIDE;
+    }
+}
+
+// Pushes a seed for every run of MATCHING pixels next to a FILLED one, like the first seed, and returns true if one was pushed.
+// Those pixels belong to the region, they were only left out because their span was dropped.
+static bool seed_unfilled_neighbours(SpanStack *stack, const unsigned char *mask, int width, int height)
+{
+    stack->overflowed = false;
+    for(int y = 0; y < height; y++){
+        const unsigned char *row = &mask[(size_t)y * width];
+        const unsigned char *above = y > 0 ? row - width : NULL;
+        const unsigned char *below = y + 1 < height ? row + width : NULL;
+        int x = 0;
+        while(x < width){
+            if(row[x] != MATCHING){
+                x++;
+                continue;
+            }
+            int start = x;
+            bool reached = start > 0 && row[start - 1] == FILLED;
+            while(x < width && row[x] == MATCHING){
+                if((above && above[x] == FILLED) || (below && below[x] == FILLED)) reached = true;
+                x++;
+            }
+            if(x < width && row[x] == FILLED) reached = true;
+            if(reached){
+                push_span(stack, start, start, y, 1);
+                push_span(stack, start, start, y - 1, -1);
+            }
+        }
+    }
+    return stack->top > 0;
+}
+
+// Span fill over the region mask, turning every MATCHING pixel 4-connected to (x, y) into FILLED.
+// Filled pixels stop matching, so they don't need to be marked as visited. The stack is bounded to 2*(width+height)
+// spans, which simple regions never fill.
+static bool fill_mask(unsigned char *mask, int width, int height, int x, int y, int bounds[4])
+{
+    SpanStack stack;
+    stack.top = 0;
+    stack.capacity = 2 * (width + height);
+    stack.overflowed = false;
+    stack.spans = malloc(sizeof(Span) * stack.capacity);
+    if(!stack.spans){
+        fprintf(stderr, "Error: failed to allocate memory for fill spans.\n");
+        return false;
+    }
+
+    bounds[0] = bounds[2] = x;
+    bounds[1] = bounds[3] = y;
+    push_span(&stack, x, x, y, 1);
+    push_span(&stack, x, x, y - 1, -1);
+
+    // Once the stack empties, the spans it dropped when full are seeded again from the filled pixels.
+    while(stack.top > 0 || (stack.overflowed && seed_unfilled_neighbours(&stack, mask, width, height))){
+        Span span = stack.spans[--stack.top];
+        if(span.y < 0 || span.y >= height) continue;
+
+        unsigned char *row = &mask[(size_t)span.y * width];
+        int x1 = span.x1;
+        int left = x1;
+
+        // Extend the span to the left of x1, the part past the parent span has to be checked back in the parent row too.
+        if(row[left] == MATCHING){
+            while(left > 0 && row[left - 1] == MATCHING){
+                left--;
+                row[left] = FILLED;
+            }
+            if(left < x1) push_span(&stack, left, x1 - 1, span.y - span.dy, -span.dy);
+        }
+
+        while(x1 <= span.x2){
+            while(x1 < width && row[x1] == MATCHING){
+                row[x1] = FILLED;
+                x1++;
+            }
+            if(x1 > left){
+                push_span(&stack, left, x1 - 1, span.y + span.dy, span.dy);
+                if(left < bounds[0]) bounds[0] = left;
+                if(x1 - 1 > bounds[2]) bounds[2] = x1 - 1;
+                if(span.y < bounds[1]) bounds[1] = span.y;
+                if(span.y > bounds[3]) bounds[3] = span.y;
+            }
+            if(x1 - 1 > span.x2) push_span(&stack, span.x2 + 1, x1 - 1, span.y - span.dy, -span.dy);
+
+            x1++;
+            while(x1 < span.x2 && row[x1] != MATCHING) x1++;
+            left = x1;
+        }
+    }
+
+    free(stack.spans);
+    return true;
+}
+
+bool flood_fill(Color *pixels, int width, int height, int x, int y, Color new_color, int tolerance, Rectangle *bounds)
+{
+    if(x < 0 || x >= width || y < 0 || y >= height) return false;
+
+    unsigned int *values = (unsigned int *)pixels;
+    unsigned int target = values[(size_t)y * width + x];
+    unsigned int replacement = color_value(new_color);
+    if(target == replacement && tolerance == 0) return false;
+
+    unsigned char *mask = malloc((size_t)width * height);
+    if(!mask){
+        fprintf(stderr, "Error: failed to allocate memory for fill mask.\n");
+        return false;
+    }
+    match_pixels(values, mask, (size_t)width * height, target, tolerance);
+
+    int box[4];
+    bool filled = fill_mask(mask, width, height, x, y, box);
+    if(filled){
+        for(int row = box[1]; row <= box[3]; row++){
+            size_t start = (size_t)row * width;
+            for(int column = box[0]; column <= box[2]; column++){
+                if(mask[start + column] == FILLED) values[start + column] = replacement;
+            }
+        }
+        if(bounds) *bounds = (Rectangle){box[0], box[1], box[2] - box[0] + 1, box[3] - box[1] + 1};
+    }
+    free(mask);
+    return filled;
+}
@@ -0,0 +1,13 @@
+#ifndef FILL_H
+#define FILL_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Fills the 4-connected region of pixels with the color of the pixel (x, y) with new_color, a row of width pixels at a time.
+// Pixels whose channels all differ by at most tolerance (0-255) from that color are part of the region, so a tolerance
+// above 0 also fills the anti-aliased edges of shapes. pixels holds width*height pixels row after row.
+// bounds, when not NULL, gets the region that was filled, in the rows of pixels. Returns false if nothing was filled.
+bool flood_fill(Color *pixels, int width, int height, int x, int y, Color new_color, int tolerance, Rectangle *bounds);
+
+#endif
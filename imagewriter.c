@@ -0,0 +1,431 @@
+#include "imagewriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the buffer of the files written, so the disk gets few large writes.
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+// Rows written between two calls to the progress function.
+#define PROGRESS_ROWS 64
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 108
+
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+// Largest image the QOI format allows.
+#define QOI_MAX_PIXELS 400000000u
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+#define QOI_OP_RGBA 0xFF
+#define QOI_MASK 0xC0
+#define QOI_MAX_RUN 62
+
+// Definition of a FileBuffer, bytes waiting to be written to file. Once a write fails failed is set and the rest are dropped.
+typedef struct
+{
+    FILE *file;
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+
+} FileBuffer;
+
+static bool open_buffer(FileBuffer *buffer, const char *path)
+{
+    buffer->file = fopen(path,"wb");
+    if(!buffer->file) return false;
+    buffer->data = malloc(WRITE_BUFFER_SIZE);
+    if(!buffer->data){
+        fclose(buffer->file);
+        remove(path);
+        return false;
+    }
+    buffer->size = 0;
+    buffer->capacity = WRITE_BUFFER_SIZE;
+    buffer->failed = false;
+    return true;
+}
+
+static void flush_buffer(FileBuffer *buffer)
+{
+    if(!buffer->failed && buffer->size > 0 && fwrite(buffer->data,1,buffer->size,buffer->file) != buffer->size) buffer->failed = true;
+    buffer->size = 0;
+}
+
+// Returns room for count more bytes at the end of buffer, whoever writes them adds count to its size. Returns NULL if there is no memory for them.
+static unsigned char *reserve_buffer(FileBuffer *buffer, size_t count)
+{
+    if(buffer->size + count > buffer->capacity) flush_buffer(buffer);
+    if(count > buffer->capacity){
+        unsigned char *data = realloc(buffer->data,count);
+        if(!data){
+            buffer->failed = true;
+            return NULL;
+        }
+        buffer->data = data;
+        buffer->capacity = count;
+    }
+    return buffer->data + buffer->size;
+}
+
+static void write_buffer(FileBuffer *buffer, const void *bytes, size_t count)
+{
+    unsigned char *room = reserve_buffer(buffer,count);
+    if(!room) return;
+    memcpy(room,bytes,count);
+    buffer->size += count;
+}
+
+// Function that writes what is left in buffer, closes its file and returns true if every byte was written, otherwise the file is removed.
+static bool close_buffer(FileBuffer *buffer, const char *path)
+{
+    flush_buffer(buffer);
+    bool written = !buffer->failed;
+    if(fclose(buffer->file) != 0) written = false;
+    free(buffer->data);
+    if(!written) remove(path);
+    return written;
+}
+
+// Returns the contents of the file at path in a malloc'd buffer and writes its size into size, or NULL if it couldn't be read.
+static unsigned char *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path,"rb");
+    if(!file) return NULL;
+    unsigned char *bytes = NULL;
+    long length = -1;
+    if(fseek(file,0,SEEK_END) == 0) length = ftell(file);
+    if(length > 0 && fseek(file,0,SEEK_SET) == 0){
+        bytes = malloc(length);
+        if(bytes && fread(bytes,1,length,file) != (size_t)length){
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+    fclose(file);
+    *size = length > 0 ? (size_t)length : 0;
+    return bytes;
+}
+
+ImageRows image_rows(Image image, bool bottom_up)
+{
+    const Color *pixels = (const Color *)image.data;
+    if(!bottom_up) return (ImageRows){pixels,image.width,image.height,image.width};
+    return (ImageRows){pixels + (size_t)(image.height - 1) * image.width,image.width,image.height,-image.width};
+}
+
+const Color *image_row(const ImageRows *rows, int y)
+{
+    return rows->pixels + (ptrdiff_t)y * rows->stride;
+}
+
+static void put_u16(unsigned char *out, uint16_t value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+    for(int i = 0; i < 4; i++) out[i] = value >> (8 * i);
+}
+
+static uint32_t get_u32(const unsigned char *in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static void put_u32_big_endian(unsigned char *out, uint32_t value)
+{
+    for(int i = 0; i < 4; i++) out[i] = value >> (24 - 8 * i);
+}
+
+static uint32_t get_u32_big_endian(const unsigned char *in)
+{
+    return ((uint32_t)in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+}
+
+bool write_bmp(const char *path, const ImageRows *rows, ProgressFunc progress, void *data)
+{
+    if(rows->width <= 0 || rows->height <= 0) return false;
+    FileBuffer buffer;
+    if(!open_buffer(&buffer,path)) return false;
+    size_t rowBytes = (size_t)rows->width * 4;
+
+    // BITMAPV4HEADER with bit fields, the only way to tell readers the fourth byte is alpha.
+    unsigned char header[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE] = {0};
+    header[0] = 'B';
+    header[1] = 'M';
+    put_u32(header + 2,BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + rowBytes * rows->height);
+    put_u32(header + 10,BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE);
+    unsigned char *info = header + BMP_FILE_HEADER_SIZE;
+    put_u32(info,BMP_INFO_HEADER_SIZE);
+    put_u32(info + 4,rows->width);
+    put_u32(info + 8,rows->height);  // Positive, the rows are stored bottom-up.
+    put_u16(info + 12,1);
+    put_u16(info + 14,32);
+    put_u32(info + 16,3);  // BI_BITFIELDS.
+    put_u32(info + 20,rowBytes * rows->height);
+    put_u32(info + 24,2835);  // 72 DPI.
+    put_u32(info + 28,2835);
+    put_u32(info + 40,0x00FF0000);
+    put_u32(info + 44,0x0000FF00);
+    put_u32(info + 48,0x000000FF);
+    put_u32(info + 52,0xFF000000);
+    memcpy(info + 56,"BGRs",4);  // LCS_sRGB, stored little-endian.
+    write_buffer(&buffer,header,sizeof(header));
+
+    for(int y = rows->height - 1; y >= 0 && !buffer.failed; y--){
+        const Color *row = image_row(rows,y);
+        unsigned char *line = reserve_buffer(&buffer,rowBytes);
+        if(!line) break;
+        for(int x = 0; x < rows->width; x++){
+            line[x * 4] = row[x].b;
+            line[x * 4 + 1] = row[x].g;
+            line[x * 4 + 2] = row[x].r;
+            line[x * 4 + 3] = row[x].a;
+        }
+        buffer.size += rowBytes;
+        if(progress && y % PROGRESS_ROWS == 0) progress((float)(rows->height - y) / rows->height,data);
+    }
+    return close_buffer(&buffer,path);
+}
+
+// QOI
+
+static int qoi_hash(Color color)
+{
+    return (color.r * 3 + color.g * 5 + color.b * 7 + color.a * 11) % 64;
+}
+
+static bool same_color(Color a, Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// Returns the difference of two channels wrapped into [-128, 127].
+static int wrapped_difference(int a, int b)
+{
+    return ((a - b + 128) & 0xFF) - 128;
+}
+
+bool write_qoi(const char *path, const ImageRows *rows, ProgressFunc progress, void *data)
+{
+    if(rows->width <= 0 || rows->height <= 0 || (uint64_t)rows->width * rows->height > QOI_MAX_PIXELS) return false;
+    FileBuffer buffer;
+    if(!open_buffer(&buffer,path)) return false;
+
+    unsigned char header[QOI_HEADER_SIZE];
+    memcpy(header,"qoif",4);
+    put_u32_big_endian(header + 4,rows->width);
+    put_u32_big_endian(header + 8,rows->height);
+    header[12] = 4;  // RGBA.
+    header[13] = 0;  // sRGB with linear alpha.
+    write_buffer(&buffer,header,sizeof(header));
+
+    Color seen[64] = {0};
+    Color previous = {0,0,0,255};
+    int run = 0;
+    for(int y = 0; y < rows->height && !buffer.failed; y++){
+        const Color *row = image_row(rows,y);
+        // Worst case, a run left from the row above and every pixel written whole.
+        unsigned char *start = reserve_buffer(&buffer,(size_t)rows->width * 5 + 1);
+        if(!start) break;
+        unsigned char *out = start;
+        for(int x = 0; x < rows->width; x++){
+            Color pixel = row[x];
+            if(same_color(pixel,previous)){
+                if(++run == QOI_MAX_RUN){
+                    *out++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if(run > 0){
+                *out++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            int hash = qoi_hash(pixel);
+            if(same_color(seen[hash],pixel)) *out++ = QOI_OP_INDEX | hash;
+            else{
+                seen[hash] = pixel;
+                if(pixel.a == previous.a){
+                    int dr = wrapped_difference(pixel.r,previous.r);
+                    int dg = wrapped_difference(pixel.g,previous.g);
+                    int db = wrapped_difference(pixel.b,previous.b);
+                    int drg = dr - dg;
+                    int dbg = db - dg;
+                    if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                        *out++ = QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                    else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7){
+                        *out++ = QOI_OP_LUMA | (dg + 32);
+                        *out++ = ((drg + 8) << 4) | (dbg + 8);
+                    }
+                    else{
+                        *out++ = QOI_OP_RGB;
+                        *out++ = pixel.r;
+                        *out++ = pixel.g;
+                        *out++ = pixel.b;
+                    }
+                }
+                else{
+                    *out++ = QOI_OP_RGBA;
+                    *out++ = pixel.r;
+                    *out++ = pixel.g;
+                    *out++ = pixel.b;
+                    *out++ = pixel.a;
+                }
+            }
+            previous = pixel;
+        }
+        buffer.size += out - start;
+        if(progress && y % PROGRESS_ROWS == 0) progress((float)(y + 1) / rows->height,data);
+    }
+    if(run > 0){
+        unsigned char last = QOI_OP_RUN | (run - 1);
+        write_buffer(&buffer,&last,1);
+    }
+    static const unsigned char padding[QOI_PADDING_SIZE] = {0,0,0,0,0,0,0,1};
+    write_buffer(&buffer,padding,QOI_PADDING_SIZE);
+    return close_buffer(&buffer,path);
+}
+
+Image load_qoi(const char *path)
+{
+    Image image = {0};
+    size_t size;
+    unsigned char *bytes = read_file(path,&size);
+    if(!bytes) return image;
+    if(size < QOI_HEADER_SIZE + QOI_PADDING_SIZE || memcmp(bytes,"qoif",4) != 0){
+        free(bytes);
+        return image;
+    }
+    uint32_t width = get_u32_big_endian(bytes + 4);
+    uint32_t height = get_u32_big_endian(bytes + 8);
+    if(width == 0 || height == 0 || (uint64_t)width * height > QOI_MAX_PIXELS){
+        free(bytes);
+        return image;
+    }
+    size_t count = (size_t)width * height;
+    Color *pixels = malloc(count * sizeof(Color));
+    if(!pixels){
+        free(bytes);
+        return image;
+    }
+
+    Color seen[64] = {0};
+    Color pixel = {0,0,0,255};
+    size_t position = QOI_HEADER_SIZE;
+    size_t end = size - QOI_PADDING_SIZE;
+    int run = 0;
+    bool valid = true;
+    for(size_t i = 0; i < count && valid; i++){
+        if(run > 0) run--;
+        else if(position < end){
+            int op = bytes[position++];
+            if(op == QOI_OP_RGB){
+                if(position + 3 > end) valid = false;
+                else{
+                    pixel.r = bytes[position];
+                    pixel.g = bytes[position + 1];
+                    pixel.b = bytes[position + 2];
+                    position += 3;
+                }
+            }
+            else if(op == QOI_OP_RGBA){
+                if(position + 4 > end) valid = false;
+                else{
+                    pixel = (Color){bytes[position],bytes[position + 1],bytes[position + 2],bytes[position + 3]};
+                    position += 4;
+                }
+            }
+            else if((op & QOI_MASK) == QOI_OP_INDEX) pixel = seen[op];
+            else if((op & QOI_MASK) == QOI_OP_DIFF){
+                pixel.r += ((op >> 4) & 3) - 2;
+                pixel.g += ((op >> 2) & 3) - 2;
+                pixel.b += (op & 3) - 2;
+            }
+            else if((op & QOI_MASK) == QOI_OP_LUMA){
+                if(position + 1 > end) valid = false;
+                else{
+                    int second = bytes[position++];
+                    int dg = (op & 0x3F) - 32;
+                    pixel.r += dg - 8 + ((second >> 4) & 0x0F);
+                    pixel.g += dg;
+                    pixel.b += dg - 8 + (second & 0x0F);
+                }
+            }
+            else run = op & 0x3F;
+            seen[qoi_hash(pixel)] = pixel;
+        }
+        else valid = false;
+        pixels[i] = pixel;
+    }
+    free(bytes);
+    if(!valid){
+        free(pixels);
+        return image;
+    }
+    image.data = pixels;
+    image.width = width;
+    image.height = height;
+    image.mipmaps = 1;
+    image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    return image;
+}
+
+// RAW RGBA
+
+bool write_raw_rgba(const char *path, const ImageRows *rows, ProgressFunc progress, void *data)
+{
+    if(rows->width <= 0 || rows->height <= 0) return false;
+    FileBuffer buffer;
+    if(!open_buffer(&buffer,path)) return false;
+
+    unsigned char header[RAW_RGBA_HEADER_SIZE] = {0};
+    memcpy(header,"RGBA",4);
+    put_u32(header + 4,rows->width);
+    put_u32(header + 8,rows->height);
+    write_buffer(&buffer,header,sizeof(header));
+
+    for(int y = 0; y < rows->height && !buffer.failed; y++){
+        write_buffer(&buffer,image_row(rows,y),(size_t)rows->width * sizeof(Color));
+        if(progress && y % PROGRESS_ROWS == 0) progress((float)(y + 1) / rows->height,data);
+    }
+    return close_buffer(&buffer,path);
+}
+
+Image load_raw_rgba(const char *path)
+{
+    Image image = {0};
+    FILE *file = fopen(path,"rb");
+    if(!file) return image;
+    unsigned char header[RAW_RGBA_HEADER_SIZE];
+    if(fread(header,1,sizeof(header),file) != sizeof(header) || memcmp(header,"RGBA",4) != 0){
+        fclose(file);
+        return image;
+    }
+    uint32_t width = get_u32(header + 4);
+    uint32_t height = get_u32(header + 8);
+    size_t count = (size_t)width * height;
+    Color *pixels = width > 0 && height > 0 && width <= 65536 && height <= 65536 ? malloc(count * sizeof(Color)) : NULL;
+    if(!pixels || fread(pixels,sizeof(Color),count,file) != count){
+        free(pixels);
+        fclose(file);
+        return image;
+    }
+    fclose(file);
+    image.data = pixels;
+    image.width = width;
+    image.height = height;
+    image.mipmaps = 1;
+    image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    return image;
+}
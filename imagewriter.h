@@ -0,0 +1,51 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Image files written straight from the rows of an image, in whatever order they are stored, so render texture copies
+// never have to be flipped first. Files are written through a large buffer so the disk gets few big writes.
+
+#define RAW_RGBA_HEADER_SIZE 16
+
+// Definition of ImageRows, the RGBA pixels of an image read row by row. Row y, counted from the top, starts at
+// pixels + y * stride, a negative stride reads images stored bottom-up like render textures.
+typedef struct s_imagerows
+{
+    const Color *pixels;
+    int width;
+    int height;
+    int stride;
+
+} ImageRows;
+
+// Called with how much of the work is done (0-1).
+typedef void (*ProgressFunc)(float progress, void *data);
+
+// Returns the rows of image, which must be 8 bit RGBA, stored bottom-up when bottom_up is true.
+ImageRows image_rows(Image image, bool bottom_up);
+
+// Returns row y, counted from the top, of rows.
+const Color *image_row(const ImageRows *rows, int y);
+
+// Function that writes rows into a 32 bit BMP file at path and returns true if it was written.
+// progress, when it isn't NULL, is called as the rows are written.
+bool write_bmp(const char *path, const ImageRows *rows, ProgressFunc progress, void *data);
+
+// Function that writes rows into a QOI file at path and returns true if it was written.
+// QOI packs runs, small differences and recently seen colors in a single pass, far faster than deflate and close to PNG in size on flat artwork.
+bool write_qoi(const char *path, const ImageRows *rows, ProgressFunc progress, void *data);
+
+// Returns the 8 bit RGBA image, with rows top-down, read from the QOI file at path. Its data is NULL if it couldn't be read.
+Image load_qoi(const char *path);
+
+// Function that writes rows into a raw RGBA file at path and returns true if it was written.
+// The file is RAW_RGBA_HEADER_SIZE bytes of header, the magic "RGBA" then the width and height as little-endian 32 bit integers
+// and 4 reserved bytes, followed by the pixels with rows top-down.
+bool write_raw_rgba(const char *path, const ImageRows *rows, ProgressFunc progress, void *data);
+
+// Returns the 8 bit RGBA image, with rows top-down, read from the raw RGBA file at path. Its data is NULL if it couldn't be read.
+Image load_raw_rgba(const char *path);
+
+#endif
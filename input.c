@@ -0,0 +1,178 @@
+#include "input.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+// Samples are kept in a ring buffer, count of them ending before next.
+struct s_inputsampler
+{
+    PointerSample samples[MAX_POINTER_SAMPLES];
+    int next;
+    int count;
+    Mutex *lock;
+    Thread *thread;
+    volatile bool running;
+    void *window;
+};
+
+static void add_sample(InputSampler *sampler, PointerSample sample)
+{
+    mutex_lock(sampler->lock);
+    sampler->samples[sampler->next] = sample;
+    sampler->next = (sampler->next + 1) % MAX_POINTER_SAMPLES;
+    if(sampler->count < MAX_POINTER_SAMPLES) sampler->count++;
+    mutex_unlock(sampler->lock);
+}
+
+#ifdef _WIN32
+// Windows keeps the last 64 moves of the mouse, more than it makes between two polls.
+#define MOVE_HISTORY 64
+
+// Function that reads the moves the mouse made after previous into moves, oldest first, the last one being cursor,
+// and makes it the new previous. Returns how many there were, 0 when cursor isn't in the history, like after
+// SetCursorPos(), or on the first call. Positions are in screen coordinates and times in GetTickCount() milliseconds.
+static int moves_since(MOUSEMOVEPOINT *previous, POINT cursor, MOUSEMOVEPOINT *moves)
+{
+    MOUSEMOVEPOINT current = {0};
+    current.x = cursor.x & 0xFFFF;
+    current.y = cursor.y & 0xFFFF;
+    MOUSEMOVEPOINT history[MOVE_HISTORY];
+    int count = GetMouseMovePointsEx(sizeof(MOUSEMOVEPOINT),&current,history,MOVE_HISTORY,GMMP_USE_DISPLAY_POINTS);
+    if(count <= 0) return 0;
+    // Display points are 16 bits, screens left of or above the main one give values past 32767.
+    for(int i = 0; i < count; i++){
+        if(history[i].x > 32767) history[i].x -= 65536;
+        if(history[i].y > 32767) history[i].y -= 65536;
+    }
+
+    // history is newest first, the moves made after previous are the ones before it.
+    int newer = 0;
+    bool known = previous->time != 0;
+    while(known && newer < count && !(history[newer].x == previous->x && history[newer].y == previous->y && history[newer].time == previous->time)) newer++;
+    *previous = history[0];
+    if(!known) return 0;
+    for(int i = 0; i < newer; i++){
+        moves[i] = history[newer - 1 - i];
+    }
+    return newer;
+}
+
+static void input_thread(void *arg)
+{
+    InputSampler *sampler = (InputSampler *)arg;
+    HWND window = (HWND)sampler->window;
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    PointerSample last = {0};
+    MOUSEMOVEPOINT previous = {0};
+    MOUSEMOVEPOINT moves[MOVE_HISTORY];
+    bool first = true;
+
+    // Sleep(1) only sleeps a millisecond with the timer resolution raised.
+    timeBeginPeriod(1);
+    while(sampler->running){
+        POINT cursor;
+        if(GetCursorPos(&cursor)){
+            // GetAsyncKeyState() reads the physical buttons, which are the other way around for left-handed users.
+            bool swapped = GetSystemMetrics(SM_SWAPBUTTON) != 0;
+            bool left = (GetAsyncKeyState(swapped ? VK_RBUTTON : VK_LBUTTON) & 0x8000) != 0;
+            bool right = (GetAsyncKeyState(swapped ? VK_LBUTTON : VK_RBUTTON) & 0x8000) != 0;
+            QueryPerformanceCounter(&counter);
+            double now = (double)counter.QuadPart / frequency.QuadPart;
+            DWORD tick = GetTickCount();
+
+            // The poll only sees where the mouse is now, the moves it made since the last one come from the history.
+            // Buttons aren't kept in it, the moves before the last one keep the buttons of the previous sample.
+            int count = moves_since(&previous,cursor,moves);
+            for(int i = 0; i < count; i++){
+                POINT point = {moves[i].x, moves[i].y};
+                if(!ScreenToClient(window,&point)) continue;
+                bool latest = i == count - 1;
+                // The ticks only count milliseconds, the times are kept in order and no later than now.
+                double time = now - (LONG)(tick - moves[i].time) / 1000.0;
+                if(time > now) time = now;
+                if(time < last.time) time = last.time;
+                last = (PointerSample){point.x, point.y, latest ? left : last.left, latest ? right : last.right, time, NO_PRESSURE};
+                add_sample(sampler,last);
+                first = false;
+            }
+
+            // Only changes are kept, a mouse standing still adds nothing.
+            if(count == 0 && ScreenToClient(window,&cursor) &&
+               (first || cursor.x != last.x || cursor.y != last.y || left != last.left || right != last.right)){
+                last = (PointerSample){cursor.x, cursor.y, left, right, now, NO_PRESSURE};
+                add_sample(sampler,last);
+                first = false;
+            }
+        }
+        Sleep(1);
+    }
+    timeEndPeriod(1);
+}
+#endif
+
+InputSampler *input_sampler(void *window)
+{
+    InputSampler *sampler = malloc(sizeof(InputSampler));
+    if(!sampler){
+        fprintf(stderr, "Error: failed to allocate memory for input sampler.\n");
+        exit(EXIT_FAILURE);
+    }
+    sampler->next = 0;
+    sampler->count = 0;
+    sampler->lock = mutex();
+    sampler->thread = NULL;
+    sampler->running = false;
+    sampler->window = window;
+#ifdef _WIN32
+    if(window){
+        sampler->running = true;
+        sampler->thread = thread_start(input_thread,sampler);
+        if(!sampler->thread){
+            fprintf(stderr, "Error: failed to start input thread, sampling once per frame.\n");
+            sampler->running = false;
+        }
+    }
+#endif
+    return sampler;
+}
+
+bool is_input_threaded(InputSampler *sampler)
+{
+    return sampler->thread != NULL;
+}
+
+void push_pointer_sample(InputSampler *sampler, PointerSample sample)
+{
+    add_sample(sampler,sample);
+}
+
+int take_pointer_samples(InputSampler *sampler, PointerSample *samples, int capacity)
+{
+    mutex_lock(sampler->lock);
+    int count = sampler->count < capacity ? sampler->count : capacity;
+    // When there are more samples than room for them the newest are kept.
+    int first = (sampler->next - count + MAX_POINTER_SAMPLES) % MAX_POINTER_SAMPLES;
+    for(int i = 0; i < count; i++){
+        samples[i] = sampler->samples[(first + i) % MAX_POINTER_SAMPLES];
+    }
+    sampler->count = 0;
+    mutex_unlock(sampler->lock);
+    return count;
+}
+
+void free_input_sampler(InputSampler *sampler)
+{
+    if(sampler->thread){
+        sampler->running = false;
+        thread_join(sampler->thread);
+    }
+    free_mutex(sampler->lock);
+    free(sampler);
+}
@@ -0,0 +1,49 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+
+// Samples the mouse faster than the frame rate, so strokes keep every movement however long a frame takes.
+// On Windows a thread polls the cursor about every millisecond and adds the moves made between two polls from the
+// history of the mouse, elsewhere the main loop adds one sample per frame.
+// It lives in its own file because windows.h clashes with raylib.h.
+
+// Most samples kept between two frames, the oldest are dropped when a frame takes longer than that.
+#define MAX_POINTER_SAMPLES 1024
+
+// Pressure of samples from devices that don't report it, like mice.
+#define NO_PRESSURE -1.0f
+
+// Definition of a PointerSample, the position of the mouse in window coordinates, its buttons and when,
+// in seconds, they were read. pressure is the pressure of a pen (0-1) or NO_PRESSURE, neither the sampling
+// thread nor raylib read pen pressure so far, which leaves it to a tablet backend.
+typedef struct s_pointersample
+{
+    float x;
+    float y;
+    bool left;
+    bool right;
+    double time;
+    float pressure;
+
+} PointerSample;
+
+typedef struct s_inputsampler InputSampler;
+
+// Creates an input sampler for the native window handle and returns a pointer to it.
+// It starts the sampling thread when the platform supports it.
+InputSampler *input_sampler(void *window);
+
+// Returns true if samples are gathered by a thread, otherwise push_pointer_sample() must be called every frame.
+bool is_input_threaded(InputSampler *sampler);
+
+// Function that adds a sample read by the main loop.
+void push_pointer_sample(InputSampler *sampler, PointerSample sample);
+
+// Function that moves the samples gathered since the last call, oldest first, into samples and returns how many there were.
+int take_pointer_samples(InputSampler *sampler, PointerSample *samples, int capacity);
+
+// Function that stops the sampling thread and frees the memory of the sampler.
+void free_input_sampler(InputSampler *sampler);
+
+#endif
@@ -0,0 +1,93 @@
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Command *command(int tool, Color first_color, Color second_color, float size)
+{
+    Command *command = malloc(sizeof(Command));
+    if(!command){
+        fprintf(stderr, "Error: failed to allocate memory for command.\n");
+        exit(EXIT_FAILURE);
+    }
+    command->tool = tool;
+    command->colors[0] = first_color;
+    command->colors[1] = second_color;
+    command->size = size;
+    command->spacing = 0.0f;
+    command->mode = 0;
+    command->has_outline = false;
+    command->is_filled = false;
+    command->smooth = false;
+    command->replayable = true;
+    command->seed = 0;
+    command->points = NULL;
+    command->values = NULL;
+    command->point_count = 0;
+    command->capacity = 0;
+    command->text = NULL;
+    return command;
+}
+
+void add_command_point(Command *command, Vector2 point)
+{
+    if(command->point_count >= command->capacity){
+        int capacity = command->capacity ? command->capacity * 2 : 8;
+        Vector2 *newPoints = realloc(command->points, sizeof(Vector2) * capacity);
+        if(!newPoints){
+            fprintf(stderr, "Error: failed to reallocate memory for command points.\n");
+            command->replayable = false;
+            return;
+        }
+        command->points = newPoints;
+        command->capacity = capacity;
+    }
+    command->points[command->point_count++] = point;
+}
+
+void add_command_value(Command *command, Vector2 point, float value)
+{
+    if(command->point_count >= command->capacity || !command->values){
+        int capacity = command->capacity ? command->capacity : 8;
+        if(command->point_count >= capacity) capacity *= 2;
+        float *newValues = realloc(command->values, sizeof(float) * capacity);
+        if(!newValues){
+            fprintf(stderr, "Error: failed to reallocate memory for command values.\n");
+            command->replayable = false;
+            return;
+        }
+        command->values = newValues;
+    }
+    int count = command->point_count;
+    add_command_point(command,point);
+    if(command->point_count > count) command->values[count] = value;
+}
+
+void set_command_text(Command *command, const char *text)
+{
+    free(command->text);
+    command->text = malloc(strlen(text) + 1);
+    if(!command->text){
+        fprintf(stderr, "Error: failed to allocate memory for command text.\n");
+        command->replayable = false;
+        return;
+    }
+    strcpy(command->text, text);
+}
+
+size_t command_bytes(const Command *command)
+{
+    size_t bytes = sizeof(Command) + sizeof(Vector2) * command->capacity;
+    if(command->values) bytes += sizeof(float) * command->capacity;
+    if(command->text) bytes += strlen(command->text) + 1;
+    return bytes;
+}
+
+void free_command(Command *command)
+{
+    if(!command) return;
+    free(command->points);
+    free(command->values);
+    free(command->text);
+    free(command);
+}
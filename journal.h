@@ -0,0 +1,55 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "include/raylib.h"
+#include "shadow.h"
+
+// Definition of a Command that records the parameters of one committed operation, so the history can replay it
+// instead of keeping its pixels. What each field means depends on the tool, which is the value of the Tools enum.
+// A command that can't be reproduced exactly from its fields has replayable set to false.
+// values, when not NULL, holds a number for each point, like the dots sprayed there by the airbrush,
+// and seed the seed of the random numbers the tool used.
+typedef struct s_command
+{
+    int tool;
+    Color colors[2];
+    float size;
+    float spacing;
+    int mode;
+    bool has_outline;
+    bool is_filled;
+    bool smooth;
+    bool replayable;
+    unsigned int seed;
+    Vector2 *points;
+    float *values;
+    int point_count;
+    int capacity;
+    char *text;
+
+} Command;
+
+// Function that draws a command into the canvas, provided by the code that knows the tools.
+typedef void (*ReplayFunc)(CanvasShadow *canvas, const Command *command);
+
+// Creates an empty command of a tool with its colors and size and returns a pointer to it.
+Command *command(int tool, Color first_color, Color second_color, float size);
+
+// Function that appends a point to the command.
+void add_command_point(Command *command, Vector2 point);
+
+// Function that appends a point and its value to the command, every point of a command with values must have one.
+void add_command_value(Command *command, Vector2 point, float value);
+
+// Function that stores a copy of text in the command.
+void set_command_text(Command *command, const char *text);
+
+// Returns the memory, in bytes, used by the command.
+size_t command_bytes(const Command *command);
+
+// Function that frees the memory of the command.
+void free_command(Command *command);
+
+#endif
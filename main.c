@@ -8,11 +8,28 @@
 #include <math.h>
 #include "include/raymath.h"
 #include "OS_paths.h"
+#include "settings.h"
+#include "fill.h"
+#include "raster.h"
+#include "brushengine.h"
+#include "strokebuffer.h"
+#include "input.h"
+#include "strokefilter.h"
+#include "airbrush.h"
+#include "export.h"
+#include "imagewriter.h"
+#include "autosave.h"
 
 #define MAX_COLORS_COUNT 42
 #define MAX_TOOLS_COUNT 12
 #define MAX_BRUSH_MODES_COUNT 2
 #define RESIZE_SQUARE_SIDE_SIZE 5
+// Seconds the result of an export stays in the footer.
+#define EXPORT_MESSAGE_TIME 3.0
+// Speed, in pixels per second, at which a dynamic brush without pen pressure is half its size and opacity.
+#define DYNAMICS_HALF_SPEED 2000.0f
+// Smallest fraction of its size and opacity a dynamic brush goes down to.
+#define MIN_DYNAMICS 0.2f
 
 #define MENU_GRAY (Color){225,225,225,255}
 
@@ -20,6 +37,9 @@ bool textSpinnerEditMode = false;
 
 Rectangle spinnerRec;
 
+// Region of the preview drawn by the last shape, line, curve, polygon or text preview, the rest of it is blank.
+Rectangle previewDrawn;
+
 // ENUMS
 
 typedef enum {
@@ -42,6 +62,11 @@ typedef enum {
     SQUARE = 1,
 } BrushMode;
 
+typedef enum {
+    SPRAY_DOTS = 0,
+    SPRAY_DENSITY = 1,
+} AirBrushMode;
+
 typedef enum{
     IDLE,
     MAKING_LINE,
@@ -51,7 +76,9 @@ typedef enum{
 typedef enum{
     PNG = 0,
     JPEG = 1,
-    BMP = 2
+    BMP = 2,
+    QOI = 3,
+    RAW_RGBA = 4
 } Format;
 
 // STRUCTS
@@ -60,17 +87,32 @@ typedef struct S_Brush {
     float size;
     BrushMode mode;
     int brushModeIndex;
+    float spacing;
+    DabStroke dabs;
+    bool smoothing;
+    StrokeFilter filter;
+    bool dynamics;
 } Brush;
 
+typedef struct S_BrushDab {
+    StrokeBuffer *buffer;
+    float size;
+    BrushMode mode;
+} BrushDab;
+
 typedef struct S_AirBrush{
     float radius;
     float spray_rate;
+    AirBrushMode mode;
+    int airBrushModeIndex;
+    SprayRandom random;
 } AirBrush;
 
 typedef struct S_Shape {
     float outline_size;
     bool has_outline;
     bool is_filled;
+    bool smooth;
 } Shape;
 
 typedef struct S_Text{
@@ -86,14 +128,14 @@ typedef struct S_Text{
 
 typedef struct S_Polygon
 {
-    int maxY;
-    int minY;
     int num_of_vertices;
     int capacity;
     Vector2 *vertices;
     float outline_size;
     bool has_outline;
     bool is_filled;
+    bool smooth;
+    FillRule fill_rule;
 
 } Polygon;
 
@@ -106,6 +148,7 @@ typedef struct S_Spline{
 } Spline;
 
 typedef void (*drawFunc)(Vector2*,Vector2*,Color,Color,Shape);
+typedef void (*rasterFunc)(CanvasShadow*,Vector2*,Vector2*,Color,Color,Shape);
 
 typedef void (*GUIFunc)(void *, Rectangle);
 
@@ -118,6 +161,11 @@ Brush *brush(int size, BrushMode mode)
     brush->size = size;
     brush->mode = mode;
     brush->brushModeIndex = (int)mode;
+    brush->spacing = DEFAULT_DAB_SPACING;
+    begin_dab_stroke(&brush->dabs);
+    brush->smoothing = true;
+    one_euro_stroke_filter(&brush->filter);
+    brush->dynamics = false;
     return brush;
 }
 
@@ -127,6 +175,9 @@ AirBrush *airbrush(int radius, float spray_rate)
     airbrush = malloc(sizeof(AirBrush));
     airbrush->radius = radius;
     airbrush->spray_rate = spray_rate;
+    airbrush->mode = SPRAY_DOTS;
+    airbrush->airBrushModeIndex = (int)SPRAY_DOTS;
+    seed_spray_random(&airbrush->random,0);
     return airbrush;
 }
 
@@ -141,6 +192,7 @@ Shape *shape(int size, bool outline, bool fill)
     shape->outline_size = size;
     shape->has_outline = outline;
     shape->is_filled = fill;
+    shape->smooth = true;
     return shape;
 }
 
@@ -182,8 +234,6 @@ void createNewVertices(Polygon *polygon){
         free(polygon->vertices);
     polygon->capacity = 32;
     polygon->num_of_vertices = 0;
-    polygon->maxY = -1;
-    polygon->minY = INT_MAX;
     polygon->vertices = malloc(sizeof(Vector2) * polygon->capacity);
     if (!polygon->vertices) {
         fprintf(stderr, "Error: failed to allocate memory for vertices.\n");
@@ -208,6 +258,8 @@ Polygon *polygon(int outline_size, bool outline, bool fill)
     polygon->outline_size = outline_size;
     polygon->has_outline = outline;
     polygon->is_filled = fill;
+    polygon->smooth = true;
+    polygon->fill_rule = FILL_EVEN_ODD;
     return polygon;                                                                                                                                  
 }
 
@@ -285,9 +337,6 @@ void addVertexToPolygon(Polygon *polygon, Vector2 v){
     }
     
     polygon->vertices[polygon->num_of_vertices++] = v;
-
-    if (v.y > polygon->maxY) polygon->maxY = v.y;
-    if (v.y < polygon->minY) polygon->minY = v.y;
 }
 
 float distanceBetweenVectors(Vector2 v1, Vector2 v2){
@@ -307,49 +356,138 @@ int changeSize(int actualSize, int increment)
 
 //BRUSH AND ERASER FUNCTIONS
 
-void brushDraw(Vector2 mouse, Vector2 lastMouse, int brushSize, BrushMode paintMode, Color color){
-    
-    if (lastMouse.x != -1 && lastMouse.y != -1)
+void stampBrushDab(Dab dab, void *data){
+    BrushDab *brushDab = (BrushDab *)data;
+    float size = brushDab->size * dab.scale;
+    if (brushDab->mode == ROUND)
+        stamp_round_dab(brushDab->buffer,dab.position,size,dab.opacity);
+    else
     {
-        float dx = mouse.x - lastMouse.x;
-        float dy = mouse.y - lastMouse.y;
-        float distance = sqrtf(dx*dx + dy*dy);
-
-        int steps = (int)distance;
-        for (int i = 0; i < steps; i++)
-        {
-            float t = (float)i / distance;
-            Vector2 interp = {
-                lastMouse.x + t * dx,
-                lastMouse.y + t * dy
-            };
-            if (paintMode == ROUND)
-                DrawCircleV(interp, brushSize, color);
-            else
-                DrawRectangle(interp.x,interp.y,brushSize,brushSize,color);
-        }
+        // Square dabs are placed by their corner, a smaller square keeps the same center.
+        float offset = (brushDab->size - size) / 2;
+        stamp_square_dab(brushDab->buffer,(Vector2){dab.position.x + offset,dab.position.y + offset},size,dab.opacity);
     }
+}
 
-    if (paintMode == ROUND)
-        DrawCircleV(mouse, brushSize, color);
+void sweepBrushDab(Dab start, Dab end, void *data){
+    BrushDab *brushDab = (BrushDab *)data;
+    float startSize = brushDab->size * start.scale;
+    float endSize = brushDab->size * end.scale;
+    if (brushDab->mode == ROUND)
+        stamp_capsule(brushDab->buffer,start.position,end.position,startSize,endSize,end.opacity);
     else
-        DrawRectangle(mouse.x,mouse.y,brushSize,brushSize,color);
+    {
+        float startOffset = (brushDab->size - startSize) / 2;
+        float endOffset = (brushDab->size - endSize) / 2;
+        stamp_square_sweep(brushDab->buffer,(Vector2){start.position.x + startOffset,start.position.y + startOffset},
+                           (Vector2){end.position.x + endOffset,end.position.y + endOffset},startSize,endSize,end.opacity);
+    }
+}
 
+// Stamps the brush into the stroke buffer up to dab. At a spacing of 0 the segment is swept at once,
+// a capsule for round brushes and the hull of the two squares for square ones.
+void brushDraw(DabStroke *dabs, StrokeBuffer *buffer, Dab dab, float brushSize, BrushMode paintMode, float spacing){
+    BrushDab brushDab = {buffer,brushSize,paintMode};
+    float diameter = paintMode == ROUND ? brushSize * 2 : brushSize;
+    stroke_to(dabs,dab,diameter,spacing,stampBrushDab,sweepBrushDab,&brushDab);
 }
 
-void paint(RenderTexture2D *canvas, Vector2 *mouseInCanvas, Vector2 *lastMouse, Brush *tool, Color color)
+// Returns the fraction of its size and opacity a dynamic brush has: the pen pressure when there is one,
+// otherwise it gets thinner and lighter the faster the stroke goes.
+float dabDynamics(float pressure, Vector2 velocity)
 {
-    BeginTextureMode(*canvas);
+    float dynamics = pressure;
+    if (pressure == NO_PRESSURE)
+    {
+        float speed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
+        dynamics = 1.0f / (1.0f + speed / DYNAMICS_HALF_SPEED);
+    }
+    return dynamics < MIN_DYNAMICS ? MIN_DYNAMICS : dynamics > 1.0f ? 1.0f : dynamics;
+}
 
-    brushDraw(*mouseInCanvas,*lastMouse,tool->size,tool->mode,color);
+void paint(CanvasShadow *canvas, RenderTexture2D *preview, StrokeBuffer *strokeBuffer, Vector2 *mouseInCanvas, Vector2 *lastMouse, Brush *tool, Color color, float dynamics)
+{
+    if (!strokeBuffer->active){
+        begin_dab_stroke(&tool->dabs);
+        begin_stroke_buffer(strokeBuffer,canvas->target->texture.width,canvas->target->texture.height,color);
+    }
+
+    brushDraw(&tool->dabs,strokeBuffer,(Dab){*mouseInCanvas,dynamics,dynamics},tool->size,tool->mode,tool->spacing);
     *lastMouse = *mouseInCanvas;
-    
-    EndTextureMode();
 
+    // The stroke is shown through the preview until it's composited into the canvas.
+    update_stroke_preview(strokeBuffer,preview);
 }
 
 // SHAPES FUNCTIONS
 
+// Returns the bounding box of count points grown by margin on every side, the region a drawing through them damages.
+Rectangle pointsBounds(const Vector2 *points, int count, float margin)
+{
+    float minX = points[0].x, maxX = minX;
+    float minY = points[0].y, maxY = minY;
+    for (int i = 1; i < count; i++)
+    {
+        if (points[i].x < minX) minX = points[i].x;
+        if (points[i].x > maxX) maxX = points[i].x;
+        if (points[i].y < minY) minY = points[i].y;
+        if (points[i].y > maxY) maxY = points[i].y;
+    }
+    return (Rectangle){floorf(minX - margin),floorf(minY - margin),ceilf(maxX - minX + 2 * margin) + 1,ceilf(maxY - minY + 2 * margin) + 1};
+}
+
+// Returns the smallest rectangle containing a and b, empty rectangles are ignored.
+Rectangle unionBounds(Rectangle a, Rectangle b)
+{
+    if(a.width <= 0 || a.height <= 0) return b;
+    if(b.width <= 0 || b.height <= 0) return a;
+    float right = fmaxf(a.x + a.width,b.x + b.width);
+    float bottom = fmaxf(a.y + a.height,b.y + b.height);
+    a.x = fminf(a.x,b.x);
+    a.y = fminf(a.y,b.y);
+    a.width = right - a.x;
+    a.height = bottom - a.y;
+    return a;
+}
+
+// Returns the region DrawSplineCatmullRom() damages. A Catmull-Rom segment can bulge out of its points,
+// but it stays inside the Bezier control points it's equivalent to.
+Rectangle splineBounds(const Vector2 *points, int count, float thickness)
+{
+    Rectangle bounds = pointsBounds(points,count,thickness);
+    for (int i = 1; i + 2 < count; i++)
+    {
+        Vector2 controls[2] = {
+            {points[i].x + (points[i + 1].x - points[i - 1].x) / 6,points[i].y + (points[i + 1].y - points[i - 1].y) / 6},
+            {points[i + 1].x - (points[i + 2].x - points[i].x) / 6,points[i + 1].y - (points[i + 2].y - points[i].y) / 6}
+        };
+        bounds = unionBounds(bounds,pointsBounds(controls,2,thickness));
+    }
+    return bounds;
+}
+
+// Function that starts drawing to the preview after clearing the region drawn in the last frame and the one about to be drawn.
+// Everything outside of them is already blank, so the rest of the preview isn't cleared.
+void beginPreview(RenderTexture2D *preview, Rectangle bounds)
+{
+    Rectangle clear = unionBounds(previewDrawn,bounds);
+    clear = GetCollisionRec(clear,(Rectangle){0,0,preview->texture.width,preview->texture.height});
+    BeginTextureMode(*preview);
+    if(clear.width > 0 && clear.height > 0){
+        BeginScissorMode(clear.x,clear.y,clear.width,clear.height);
+        ClearBackground(BLANK);
+        EndScissorMode();
+    }
+    previewDrawn = bounds;
+}
+
+// Function that clears what was drawn in the preview.
+void clearPreview(RenderTexture2D *preview)
+{
+    beginPreview(preview,(Rectangle){0});
+    EndTextureMode();
+}
+
 Vector2 getTopLeft(Vector2 *lastMouse, Vector2 *mouseInCanvas)
 {
     Vector2 topleft = {lastMouse->x,lastMouse->y};
@@ -375,44 +513,43 @@ void drawRec(Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color
 
 }
 
-void drawEllipseOutline(int centerX, int centerY, float radiusH, float radiusV, float thickness, Color color, int segments)
+void drawEllipseOutline(int centerX, int centerY, float radiusH, float radiusV, float thickness, Color color)
 {
-    if (radiusH <= 0 || radiusV <= 0 || thickness <= 0 || segments < 3) return;
+    if (radiusH <= 0 || radiusV <= 0 || thickness <= 0) return;
 
     float innerRadiusH = radiusH - thickness;
     float innerRadiusV = radiusV - thickness;
     if (innerRadiusH < 0) innerRadiusH = 0;
     if (innerRadiusV < 0) innerRadiusV = 0;
-    float angleStep = 2 * PI / segments;
 
+    // Enough segments for the outer edge to stay within MAX_CHORD_ERROR of the ellipse.
+    int segments = curve_segments(radiusH > radiusV ? radiusH : radiusV,MAX_CHORD_ERROR);
+    int pointCount = 2 * (segments + 1);
+    Vector2 *strip = malloc(sizeof(Vector2) * pointCount);
+    if (!strip) {
+        fprintf(stderr, "Error: failed to allocate memory for ellipse outline.\n");
+        return;
+    }
+
+    // Outer and inner points alternate so the whole ring is one triangle strip,
+    // the point on the unit circle is rotated one step at a time instead of calling cosf and sinf for each one.
+    float stepCos = cosf(2 * PI / segments);
+    float stepSin = sinf(2 * PI / segments);
+    float c = 1.0f;
+    float s = 0.0f;
     for (int i = 0; i < segments; i++)
     {
-        float angle0 = i * angleStep;
-        float angle1 = (i + 1) * angleStep;
-
-        // Outer ring points
-        Vector2 p1 = {
-            centerX + cosf(angle0) * radiusH,
-            centerY + sinf(angle0) * radiusV
-        };
-        Vector2 p2 = {
-            centerX + cosf(angle1) * radiusH,
-            centerY + sinf(angle1) * radiusV
-        };
-
-        // Inner ring points
-        Vector2 p3 = {
-            centerX + cosf(angle1) * innerRadiusH,
-            centerY + sinf(angle1) * innerRadiusV
-        };
-        Vector2 p4 = {
-            centerX + cosf(angle0) * innerRadiusH,
-            centerY + sinf(angle0) * innerRadiusV
-        };
-        // Two triangles forming a quad
-        DrawTriangle(p3, p2, p1, color);
-        DrawTriangle(p1, p4, p3, color);
+        strip[2*i] = (Vector2){centerX + c * radiusH, centerY + s * radiusV};
+        strip[2*i + 1] = (Vector2){centerX + c * innerRadiusH, centerY + s * innerRadiusV};
+        float rotated = c * stepCos - s * stepSin;
+        s = s * stepCos + c * stepSin;
+        c = rotated;
     }
+    strip[2*segments] = strip[0];
+    strip[2*segments + 1] = strip[1];
+
+    DrawTriangleStrip(strip,pointCount,color);
+    free(strip);
 }
 
 void drawOval(Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color, Shape ovalInfo)
@@ -427,20 +564,90 @@ void drawOval(Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color
     if(ovalInfo.is_filled)
         DrawEllipse(centerX,centerY,radiusH,radiusV,fill_color);
     if(ovalInfo.has_outline){
-        drawEllipseOutline(centerX,centerY,radiusH,radiusV,ovalInfo.outline_size,outline_color,32);
+        drawEllipseOutline(centerX,centerY,radiusH,radiusV,ovalInfo.outline_size,outline_color);
     }
                     
 }
 
-void drawShape(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color,Shape shapeInfo, drawFunc draw_func, bool isMouseOverCanvas, DoublyLinkedList *history){
+void fillPath(CanvasShadow *canvas, Path *path, FillRule rule, Color color)
+{
+    sync_shadow(canvas);
+    Rectangle bounds;
+    if(fill_path(get_shadow_row(canvas,0),canvas->image.width,canvas->image.height,-canvas->image.width,path,rule,color,&bounds)){
+        mark_shadow_changed(canvas,bounds);
+    }
+}
+
+// Same rectangle as drawRec(), with anti-aliased edges.
+void rasterRec(CanvasShadow *canvas, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color, Shape recInfo){
+    Vector2 topleft = getTopLeft(lastMouse,mouseInCanvas);
+    Rectangle rec = {topleft.x,topleft.y,fabsf(mouseInCanvas->x-lastMouse->x),fabsf(mouseInCanvas->y - lastMouse->y)};
+    Path *recPath = path();
+
+    if(recInfo.is_filled){
+        add_rectangle_contour(recPath,rec,1);
+        fillPath(canvas,recPath,FILL_NON_ZERO,fill_color);
+    }
+    if(recInfo.has_outline){
+        // Like DrawRectangleLinesEx(), the outline goes inside the rectangle.
+        clear_path(recPath);
+        add_rectangle_contour(recPath,rec,1);
+        float size = recInfo.outline_size;
+        if(rec.width > 2 * size && rec.height > 2 * size)
+            add_rectangle_contour(recPath,(Rectangle){rec.x + size,rec.y + size,rec.width - 2 * size,rec.height - 2 * size},-1);
+        fillPath(canvas,recPath,FILL_NON_ZERO,outline_color);
+    }
+    free_path(recPath);
+}
+
+// Same oval as drawOval(), with anti-aliased edges.
+void rasterOval(CanvasShadow *canvas, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color, Shape ovalInfo)
+{
+    Vector2 topleft = getTopLeft(lastMouse,mouseInCanvas);
+    float radiusH = fabsf(mouseInCanvas->x - lastMouse->x) / 2;
+    float radiusV = fabsf(mouseInCanvas->y - lastMouse->y) / 2;
+    Vector2 center = {topleft.x + radiusH,topleft.y + radiusV};
+    Path *ovalPath = path();
+
+    if(ovalInfo.is_filled){
+        add_ellipse_contour(ovalPath,center,radiusH,radiusV,1);
+        fillPath(canvas,ovalPath,FILL_NON_ZERO,fill_color);
+    }
+    if(ovalInfo.has_outline){
+        clear_path(ovalPath);
+        add_ellipse_contour(ovalPath,center,radiusH,radiusV,1);
+        add_ellipse_contour(ovalPath,center,radiusH - ovalInfo.outline_size,radiusV - ovalInfo.outline_size,-1);
+        fillPath(canvas,ovalPath,FILL_NON_ZERO,outline_color);
+    }
+    free_path(ovalPath);
+}
+
+// Draws the shape into the canvas, anti-aliased on the CPU when it's smooth.
+void commitShape(CanvasShadow *canvas, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color, Shape shapeInfo, drawFunc draw_func, rasterFunc raster_func)
+{
+    if(shapeInfo.smooth && raster_func != NULL){
+        raster_func(canvas,lastMouse,mouseInCanvas,fill_color,outline_color,shapeInfo);
+        upload_shadow(canvas);
+        return;
+    }
+    begin_canvas_mode(canvas);
+    if(draw_func != NULL)
+    {
+        // Rectangles and ovals are drawn inside the box of the two points.
+        damage_canvas(canvas,pointsBounds((Vector2[]){*lastMouse,*mouseInCanvas},2,2));
+        draw_func(lastMouse,mouseInCanvas,fill_color,outline_color,shapeInfo);
+    }
+    end_canvas_mode(canvas);
+}
+
+void drawShape(MouseButton mouse_button,CanvasShadow *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color fill_color, Color outline_color,Shape shapeInfo, Tools tool, drawFunc draw_func, rasterFunc raster_func, bool isMouseOverCanvas, DoublyLinkedList *history){
     if(IsMouseButtonPressed(mouse_button) && isMouseOverCanvas)
     {
         *lastMouse = *mouseInCanvas;
     }
     else if(IsMouseButtonDown(mouse_button) && !Vector2Equals(*lastMouse,(Vector2){-1,-1}))
     {
-        BeginTextureMode(*preview);
-        ClearBackground(BLANK);
+        beginPreview(preview,pointsBounds((Vector2[]){*lastMouse,*mouseInCanvas},2,2));
         if(draw_func != NULL)
         {
             draw_func(lastMouse,mouseInCanvas,fill_color,outline_color,shapeInfo);
@@ -449,47 +656,50 @@ void drawShape(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2D
     }
     else if(IsMouseButtonReleased(mouse_button) && !Vector2Equals(*lastMouse,(Vector2){-1,-1}))
     {
-        BeginTextureMode(*preview);
-        ClearBackground(BLANK);
-        EndTextureMode();
-        BeginTextureMode(*canvas);
-        if(draw_func != NULL)
-        {
-            draw_func(lastMouse,mouseInCanvas,fill_color,outline_color,shapeInfo);
-        }
-        EndTextureMode();
-        add_node(history,canvas->texture);
+        clearPreview(preview);
+        commitShape(canvas,lastMouse,mouseInCanvas,fill_color,outline_color,shapeInfo,draw_func,raster_func);
+        Command *shapeCommand = command(tool,fill_color,outline_color,shapeInfo.outline_size);
+        shapeCommand->has_outline = shapeInfo.has_outline;
+        shapeCommand->is_filled = shapeInfo.is_filled;
+        shapeCommand->smooth = shapeInfo.smooth;
+        add_command_point(shapeCommand,*lastMouse);
+        add_command_point(shapeCommand,*mouseInCanvas);
+        add_node(history,canvas,shapeCommand);
         lastMouse->x = -1;
         lastMouse->y = -1;
     }
 
 }
 
-void drawLine(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color color,int lineSize, bool isMouseOverCanvas, DoublyLinkedList *history){
+void drawRoundLine(Vector2 start, Vector2 end, int lineSize, Color color)
+{
+    DrawCircle(start.x,start.y,lineSize/2,color);
+    DrawLineEx(start,end,lineSize,color);
+    DrawCircle(end.x,end.y,lineSize/2,color);
+}
+
+void drawLine(MouseButton mouse_button,CanvasShadow *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color color,int lineSize, bool isMouseOverCanvas, DoublyLinkedList *history){
     if(IsMouseButtonPressed(mouse_button) && isMouseOverCanvas)
     {
         *lastMouse = *mouseInCanvas;
     }
     else if(IsMouseButtonDown(mouse_button) && !Vector2Equals(*lastMouse,(Vector2){-1,-1}))
     {
-        BeginTextureMode(*preview);
-        ClearBackground(BLANK);
-        DrawCircle(lastMouse->x,lastMouse->y,lineSize/2,color);
-        DrawLineEx(*lastMouse,*mouseInCanvas,lineSize,color);
-        DrawCircle(mouseInCanvas->x,mouseInCanvas->y,lineSize/2,color);
+        beginPreview(preview,pointsBounds((Vector2[]){*lastMouse,*mouseInCanvas},2,lineSize / 2 + 2));
+        drawRoundLine(*lastMouse,*mouseInCanvas,lineSize,color);
         EndTextureMode();
     }
     else if(IsMouseButtonReleased(mouse_button) && !Vector2Equals(*lastMouse,(Vector2){-1,-1}))
     {
-        BeginTextureMode(*preview);
-        ClearBackground(BLANK);
-        EndTextureMode();
-        BeginTextureMode(*canvas);
-        DrawCircle(lastMouse->x,lastMouse->y,lineSize/2,color);
-        DrawLineEx(*lastMouse,*mouseInCanvas,lineSize,color);
-        DrawCircle(mouseInCanvas->x,mouseInCanvas->y,lineSize/2,color);
-        EndTextureMode();
-        add_node(history,canvas->texture);
+        clearPreview(preview);
+        begin_canvas_mode(canvas);
+        damage_canvas(canvas,pointsBounds((Vector2[]){*lastMouse,*mouseInCanvas},2,lineSize / 2 + 2));
+        drawRoundLine(*lastMouse,*mouseInCanvas,lineSize,color);
+        end_canvas_mode(canvas);
+        Command *lineCommand = command(LINE,color,BLANK,lineSize);
+        add_command_point(lineCommand,*lastMouse);
+        add_command_point(lineCommand,*mouseInCanvas);
+        add_node(history,canvas,lineCommand);
         lastMouse->x = -1;
         lastMouse->y = -1;
         
@@ -505,13 +715,12 @@ void setAndDrawSplinePoints(Spline *spline,RenderTexture2D *preview,Vector2 *mou
     int y2 = spline->points[2].y + 0.25f * (spline->points[2].y -spline->points[1].y);
     spline->points[0] = (Vector2){x1,y1};
     spline->points[3] = (Vector2){x2,y2};
-    BeginTextureMode(*preview);
-    ClearBackground(BLANK);
+    beginPreview(preview,splineBounds(spline->points,spline->max_points,spline->thickness / 2 + 2));
     DrawSplineCatmullRom(spline->points,spline->max_points,spline->thickness, color);
     EndTextureMode();
 }
 
-void drawSpline(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2D *preview,Vector2 *lastMouse,Vector2 *mouseInCanvas,Color color,Spline *spline,bool isMouseOverCanvas, DoublyLinkedList *history){
+void drawSpline(MouseButton mouse_button,CanvasShadow *canvas, RenderTexture2D *preview,Vector2 *lastMouse,Vector2 *mouseInCanvas,Color color,Spline *spline,bool isMouseOverCanvas, DoublyLinkedList *history){
     if(IsMouseButtonPressed(mouse_button) && isMouseOverCanvas){
         if(spline->state == IDLE){
             spline->points[1] = (Vector2){mouseInCanvas->x,mouseInCanvas->y};
@@ -531,8 +740,7 @@ void drawSpline(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2
             memcpy(previewPoints, spline->points, sizeof(Vector2) * spline->max_points);    
             Vector2 bend_vector = (Vector2){(mouseInCanvas->x - lastMouse->x) * 5,(mouseInCanvas->y - lastMouse->y) * 5};
             previewPoints[spline->index] = (Vector2){previewPoints[spline->index].x - bend_vector.x,previewPoints[spline->index].y - bend_vector.y};
-            BeginTextureMode(*preview);
-            ClearBackground(BLANK);
+            beginPreview(preview,splineBounds(previewPoints,spline->max_points,spline->thickness / 2 + 2));
             DrawSplineCatmullRom(previewPoints,spline->max_points,spline->thickness, color);
             EndTextureMode();
         }
@@ -544,21 +752,24 @@ void drawSpline(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2
             spline->state = BENDING; 
         }
         else if(spline->state == BENDING){
-            BeginTextureMode(*preview);
-            ClearBackground(BLANK);
-            EndTextureMode();
+            clearPreview(preview);
             Vector2 bend_vector = (Vector2){(mouseInCanvas->x - lastMouse->x) * 5,(mouseInCanvas->y - lastMouse->y) * 5};
             spline->points[spline->index] = (Vector2){spline->points[spline->index].x - bend_vector.x,spline->points[spline->index].y - bend_vector.y};
             if(spline->index == spline->max_points -1){
-                BeginTextureMode(*canvas);
+                begin_canvas_mode(canvas);
+                damage_canvas(canvas,splineBounds(spline->points,spline->max_points,spline->thickness / 2 + 2));
                 DrawSplineCatmullRom(spline->points,spline->max_points,spline->thickness, color);
-                EndTextureMode();
+                end_canvas_mode(canvas);
                 spline->state = IDLE; 
                 spline->index = 0;
-                add_node(history,canvas->texture);
+                Command *splineCommand = command(CURVE,color,BLANK,spline->thickness);
+                for(int i = 0; i < spline->max_points; i++){
+                    add_command_point(splineCommand,spline->points[i]);
+                }
+                add_node(history,canvas,splineCommand);
             }
             else{
-                BeginTextureMode(*preview);
+                beginPreview(preview,splineBounds(spline->points,spline->max_points,spline->thickness / 2 + 2));
                 DrawSplineCatmullRom(spline->points,spline->max_points,spline->thickness, color);
                 EndTextureMode();
                 spline->index = spline->max_points -1;
@@ -571,76 +782,79 @@ void drawSpline(MouseButton mouse_button,RenderTexture2D *canvas, RenderTexture2
 
 // POLYGON FUNCTIONS
 
-int Comparer(const void *a, const void *b){
-    Vector2 *v1 = (Vector2 *)a;
-    Vector2 *v2 = (Vector2 *)b;
-
-    return v1->x - v2->x;
+void fillPolygon(CanvasShadow *canvas, Polygon *poly, Color fill_color)
+{
+    sync_shadow(canvas);
+    Rectangle bounds;
+    if(fill_polygon(get_shadow_row(canvas,0),canvas->image.width,canvas->image.height,-canvas->image.width,
+                    poly->vertices,poly->num_of_vertices,poly->fill_rule,fill_color,&bounds)){
+        mark_shadow_changed(canvas,bounds);
+    }
 }
 
-void fillPolygon(Polygon *poly, Color fill_color) {
-    Vector2 *intersections;
-    int num_of_intersections;
-
-    for (int y = poly->minY; y <= poly->maxY; y++) {
-        intersections = malloc(sizeof(Vector2) * poly->num_of_vertices);
-        num_of_intersections = 0;
-
-        for (int i = 0; i < poly->num_of_vertices; i++) {
-            float x1 = poly->vertices[i].x;
-            float y1 = poly->vertices[i].y;
-            float x2 = poly->vertices[(i + 1) % poly->num_of_vertices].x;
-            float y2 = poly->vertices[(i + 1) % poly->num_of_vertices].y;
-
-            if (y1 == y2) continue; // skip horizontal edges
-
-            float ymin = fmin(y1, y2);
-            float ymax = fmax(y1, y2);
+// Draws the polygon with anti-aliased edges, its outline is a round segment along every edge.
+void rasterClosedPolygon(CanvasShadow *canvas, Polygon *poly, Color outline_color, Color fill_color)
+{
+    Path *polyPath = path();
+    if(poly->is_filled){
+        for(int i = 0; i < poly->num_of_vertices; i++) add_path_point(polyPath,poly->vertices[i]);
+        close_path_contour(polyPath);
+        fillPath(canvas,polyPath,poly->fill_rule,fill_color);
+    }
+    if(poly->has_outline){
+        clear_path(polyPath);
+        for(int i = 0; i < poly->num_of_vertices; i++)
+            add_round_segment(polyPath,poly->vertices[i],poly->vertices[(i+1)%poly->num_of_vertices],poly->outline_size);
+        fillPath(canvas,polyPath,FILL_NON_ZERO,outline_color);
+    }
+    free_path(polyPath);
+    upload_shadow(canvas);
+}
 
-            if (y > ymin && y <= ymax) {
-                float t = (y - y1) / (y2 - y1);
-                float x = x1 + t * (x2 - x1);
-                intersections[num_of_intersections++] = (Vector2){x, y};
-            }
+void drawClosedPolygon(CanvasShadow *canvas, Polygon *poly, Color outline_color, Color fill_color)
+{
+    if(poly->smooth){
+        rasterClosedPolygon(canvas,poly,outline_color,fill_color);
+        return;
+    }
+    // The fill is written into the shadow, begin_canvas_mode() uploads it before the outline is drawn over it.
+    if(poly->is_filled){
+        fillPolygon(canvas,poly,fill_color);
+    }
+    begin_canvas_mode(canvas);
+    damage_canvas(canvas,pointsBounds(poly->vertices,poly->num_of_vertices,poly->has_outline ? poly->outline_size / 2 + 2 : 2));
+    for(int i = 0; i < poly->num_of_vertices;i++)
+    {
+        if(poly->has_outline){
+            DrawLineEx(poly->vertices[i],poly->vertices[(i+1)%poly->num_of_vertices],poly->outline_size,outline_color);
+            DrawCircle(poly->vertices[(i+1)%poly->num_of_vertices].x,poly->vertices[(i+1)%poly->num_of_vertices].y,poly->outline_size/2,outline_color);
         }
-
-        qsort(intersections, num_of_intersections, sizeof(Vector2), Comparer);
-
-        for (int i = 0; i < num_of_intersections - 1; i += 2) {
-            DrawLineEx(intersections[i], intersections[i + 1], 1, fill_color);
+        else{
+            DrawLineEx(poly->vertices[i],poly->vertices[(i+1)%poly->num_of_vertices],1,fill_color);
         }
-
-        free(intersections);
+        
     }
+    end_canvas_mode(canvas);
 }
 
-void drawPolygon(RenderTexture2D *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color outline_color, Color fill_color,Polygon *poly,DoublyLinkedList *history){
+void drawPolygon(CanvasShadow *canvas, RenderTexture2D *preview, Vector2 *lastMouse, Vector2 *mouseInCanvas,Color outline_color, Color fill_color,Polygon *poly,DoublyLinkedList *history){
     
     if(poly->num_of_vertices > 2){
         float dist = distanceBetweenVectors(poly->vertices[0],*mouseInCanvas);
         if(dist < poly->outline_size + 3.0f){
 
-            BeginTextureMode(*preview);
-            ClearBackground(BLANK);
-            EndTextureMode();
-            BeginTextureMode(*canvas);
-            if(poly->is_filled){
-                fillPolygon(poly,fill_color);
+            clearPreview(preview);
+            drawClosedPolygon(canvas,poly,outline_color,fill_color);
+            Command *polygonCommand = command(POLYGON,outline_color,fill_color,poly->outline_size);
+            polygonCommand->has_outline = poly->has_outline;
+            polygonCommand->is_filled = poly->is_filled;
+            polygonCommand->mode = poly->fill_rule;
+            polygonCommand->smooth = poly->smooth;
+            for(int i = 0; i < poly->num_of_vertices; i++){
+                add_command_point(polygonCommand,poly->vertices[i]);
             }
-            for(int i = 0; i < poly->num_of_vertices;i++)
-            {
-                if(poly->has_outline){
-                    DrawLineEx(poly->vertices[i],poly->vertices[(i+1)%poly->num_of_vertices],poly->outline_size,outline_color);
-                    DrawCircle(poly->vertices[(i+1)%poly->num_of_vertices].x,poly->vertices[(i+1)%poly->num_of_vertices].y,poly->outline_size/2,outline_color);
-                }
-                else{
-                    DrawLineEx(poly->vertices[i],poly->vertices[(i+1)%poly->num_of_vertices],1,fill_color);
-                }
-                
-            }
-            EndTextureMode();
             createNewVertices(poly);
-            add_node(history,canvas->texture);
+            add_node(history,canvas,polygonCommand);
             lastMouse->x = -1;
             lastMouse->y = -1;
             return;
@@ -649,7 +863,9 @@ void drawPolygon(RenderTexture2D *canvas, RenderTexture2D *preview, Vector2 *las
     addVertexToPolygon(poly,*mouseInCanvas);
     if(poly->num_of_vertices > 1)
     {
+        // The edges drawn so far stay in the preview, so the region kept is grown by the new edge.
         BeginTextureMode(*preview);
+        previewDrawn = unionBounds(previewDrawn,pointsBounds(&poly->vertices[poly->num_of_vertices-2],2,poly->has_outline ? poly->outline_size / 2 + 2 : 2));
         if(poly->has_outline){
             DrawLineEx(poly->vertices[poly->num_of_vertices-2],poly->vertices[poly->num_of_vertices-1],poly->outline_size,outline_color);
             DrawCircle(poly->vertices[poly->num_of_vertices-1].x,poly->vertices[poly->num_of_vertices-1].y,poly->outline_size/2,outline_color);
@@ -673,112 +889,78 @@ bool isInsideBounds(int width, int height, int x, int y)
     return false;
 }
 
-int get_next_pixels(int width, int height, Image canvasImage, Vector2 *current_pixel, Color current_pixel_color,Color *colors_from_image, Vector2 *next_pixels[])
+void fill(CanvasShadow *canvas, Vector2 first_pixel, Color new_color, int tolerance)
 {
-    int n = 0;
-
-    Vector2 adjacent_pixels[4] = {
-        {current_pixel->x - 1,current_pixel->y},
-        {current_pixel->x + 1,current_pixel->y},
-        {current_pixel->x,current_pixel->y - 1},
-        {current_pixel->x,current_pixel->y + 1}
-    };
-    int color_index;
-    for(int i = 0; i < 4; i++){
-        
-        if(isInsideBounds(width,height,adjacent_pixels[i].x,adjacent_pixels[i].y))
-        {
-            color_index = (height - adjacent_pixels[i].y -1 ) * width + adjacent_pixels[i].x;
-            Color adjacent_pixel_color = colors_from_image[color_index];
-            if(ColorIsEqual(current_pixel_color,adjacent_pixel_color))
-            {
-                Vector2 *copy = malloc(sizeof(Vector2));
-                *copy = adjacent_pixels[i];
-                next_pixels[n++] = copy;
-            }
-        }
-    }
-
-    return n;
-}
-
-void fill(RenderTexture2D *canvas, Vector2 first_pixel, Color new_color)
-{
-    int width = canvas->texture.width;
-    int height = canvas->texture.height;
+    Color *pixels = sync_shadow(canvas);
+    int width = canvas->image.width;
+    int height = canvas->image.height;
 
     if(!isInsideBounds(width,height,first_pixel.x,first_pixel.y)) return;
 
-    Image canvasImage = LoadImageFromTexture(canvas->texture);
-
-    Color *all_colors_from_image = LoadImageColors(canvasImage);
-
-    int initial_color_index =(height - first_pixel.y -1 ) * width + first_pixel.x;
-
-    Color initial_color = all_colors_from_image[initial_color_index];
-
-    if(ColorIsEqual(initial_color,new_color)) return;
-
-    Vector2 *open = malloc((width*height)*sizeof(Vector2));
-    int top_of_open_stack = 0;
-    bool *visited = calloc(width * height, sizeof(bool));
-
-    open[top_of_open_stack++] = first_pixel;
-
-    Vector2 *next_pixels[4];
-
-    int n;
-
-    while(top_of_open_stack > 0)
-    {
-        Vector2 currentPixel = open[--top_of_open_stack];
-        int current_color_index = (height - currentPixel.y -1 ) * width + currentPixel.x;
-        all_colors_from_image[current_color_index] = new_color;
-        visited[(int)currentPixel.y * width + (int)currentPixel.x] = true;
-        n = get_next_pixels(width,height,canvasImage,&currentPixel,initial_color,all_colors_from_image,next_pixels);
-        for(int i = 0; i < n; i++)
-        {
-            if(!visited[(int)next_pixels[i]->y * width + (int)next_pixels[i]->x]){
-                open[top_of_open_stack++] = *next_pixels[i];
-                visited[(int)next_pixels[i]->y * width + (int)next_pixels[i]->x] = true;
-            }
-            free(next_pixels[i]);
-        }
+    // The shadow stores rows bottom-up, like the render texture.
+    Rectangle bounds;
+    if(flood_fill(pixels,width,height,first_pixel.x,height - (int)first_pixel.y - 1,new_color,tolerance,&bounds)){
+        // The bounds are in the bottom-up rows of the shadow.
+        bounds.y = height - bounds.y - bounds.height;
+        mark_shadow_changed(canvas,bounds);
+        upload_shadow(canvas);
     }
-    UpdateTexture(canvas->texture,all_colors_from_image);
-    UnloadImageColors(all_colors_from_image);
-    UnloadImage(canvasImage);
-    free(open);
-    free(visited);
 }
 
 // AIRBRUSH FUNCTIONS
 
-void DrawAirbrush(RenderTexture2D *canvas, Vector2 mousePos, Color color, int radius, float sprayRate, float *dotAccumulator) {
+// Sprays count dots of color around center into the canvas, the caller uploads them.
+void sprayAirbrush(CanvasShadow *canvas, SprayRandom *random, Vector2 center, float radius, int count, Color color)
+{
+    sync_shadow(canvas);
+    Rectangle bounds;
+    if(spray_dots(get_shadow_row(canvas,0),canvas->image.width,canvas->image.height,-canvas->image.width,
+                  random,center,radius,count,color,&bounds)){
+        mark_shadow_changed(canvas,bounds);
+    }
+}
+
+void DrawAirbrush(CanvasShadow *canvas, Command *stroke, AirBrush *airbrush, Vector2 mousePos, Color color, float *dotAccumulator) {
 
     float deltaTime = GetFrameTime();
-    *dotAccumulator += sprayRate * deltaTime;
+    *dotAccumulator += airbrush->spray_rate * deltaTime;
 
     int dotsToDraw = (int)(*dotAccumulator);
     *dotAccumulator -= dotsToDraw;
 
     if (dotsToDraw <= 0) return;
 
-    BeginTextureMode(*canvas);
+    sprayAirbrush(canvas,&airbrush->random,mousePos,airbrush->radius,dotsToDraw,color);
+    upload_shadow(canvas);
 
-    for (int i = 0; i < dotsToDraw; i++) {
-        // get an angle between [0,360] and convert to radians
-        float angle = GetRandomValue(0, 360) * DEG2RAD;
-        // get random number between [0,10000] normalize it so it gets a float between [0,1] and then multiply by the radius to get the distance to the center.
-        float dist = sqrtf(GetRandomValue(0, 10000) / 10000.0f) * radius;
-        // get dot position
-        int x = (int)(mousePos.x + cosf(angle) * dist);
-        int y = (int)(mousePos.y + sinf(angle) * dist);
-        DrawPixel(x, y, color);
-    }
+    // The stroke replays the dots from its seed, so it records how many were sprayed at each point.
+    if(stroke->size != airbrush->radius || !ColorIsEqual(stroke->colors[0],color))
+        stroke->replayable = false;
+    add_command_value(stroke,mousePos,dotsToDraw);
+}
 
-    EndTextureMode();
+// Returns the coverage at the center of a Gaussian splat of radius holding as much paint as dots single pixels.
+float densityPeak(float radius, float dots)
+{
+    // The splat's standard deviation is a third of its radius and its volume 2 * PI * sigma^2 * peak.
+    float sigma = radius / 3.0f;
+    return dots * 255.0f / (2.0f * PI * sigma * sigma);
+}
 
+// Sprays a frame of paint into the stroke buffer as a smooth Gaussian splat, which adds up while the button is held.
+void DrawDensityAirbrush(CanvasShadow *canvas, RenderTexture2D *preview, StrokeBuffer *strokeBuffer, Command *stroke, AirBrush *airbrush, Vector2 mousePos, Color color)
+{
+    if (!strokeBuffer->active)
+        begin_stroke_buffer(strokeBuffer,canvas->target->texture.width,canvas->target->texture.height,color);
+
+    float dots = airbrush->spray_rate * GetFrameTime();
+    // The count of splats so far moves the dither pattern, the stroke's point count is the same when it's replayed.
+    splat_gaussian(strokeBuffer,mousePos,airbrush->radius,densityPeak(airbrush->radius,dots),stroke->point_count);
+    update_stroke_preview(strokeBuffer,preview);
+
+    if(stroke->size != airbrush->radius || !ColorIsEqual(stroke->colors[0],color))
+        stroke->replayable = false;
+    add_command_value(stroke,mousePos,dots);
 }
 
 // TEXT FUNCTIONS
@@ -854,17 +1036,186 @@ void DrawCaret(RenderTexture2D *target,Text *text, Color color)
     }
 }
 
+// Returns the region the caret covers when drawn by DrawCaret().
+Rectangle caretBounds(Text *text)
+{
+    Vector2 caretPos = MeasureTextEx(GetFontDefault(),&text->buffer[text->last_newline_index], text->font_size, 2.0f);
+    return (Rectangle){floorf(text->pos.x + caretPos.x) - 2,floorf(text->pos.y + text->line_count * text->font_size) - 2,4,text->font_size + 4};
+}
+
+// Returns the region the text covers when drawn by DrawTextToScreen(), without the caret.
+Rectangle textBounds(Text *text)
+{
+    Vector2 size = MeasureTextEx(GetFontDefault(),text->buffer,text->font_size,2);
+    return (Rectangle){floorf(text->pos.x) - 2,floorf(text->pos.y) - 2,ceilf(size.x) + 4,ceilf(size.y) + 4};
+}
+
 void DrawTextToScreen(RenderTexture2D *target,Text *text, Color color){
-    BeginTextureMode(*target);
     if(text->is_writing){
-        ClearBackground(BLANK); // Only clears background if the target is the preview.
+        // Only clears background if the target is the preview.
+        beginPreview(target,unionBounds(textBounds(text),caretBounds(text)));
         DrawCaret(target,text,DARKGRAY);
     }
+    else BeginTextureMode(*target);
     DrawTextEx(GetFontDefault(),text->buffer,text->pos,text->font_size,2,color);
 
     EndTextureMode();
 }
 
+// HISTORY FUNCTIONS
+
+void recordStroke(Command **stroke, Tools tool, Brush *brush, Color color, Vector2 point, float dynamics)
+{
+    if(*stroke == NULL){
+        *stroke = command(tool,color,BLANK,brush->size);
+        (*stroke)->mode = brush->mode;
+        (*stroke)->spacing = brush->spacing;
+    }
+    // The size can be changed with the mouse wheel in the middle of a stroke, which a single command can't replay.
+    if((*stroke)->size != brush->size || (*stroke)->mode != (int)brush->mode || (*stroke)->spacing != brush->spacing
+       || !ColorIsEqual((*stroke)->colors[0],color)
+       || ((*stroke)->point_count > 0 && ((*stroke)->values != NULL) != brush->dynamics))
+        (*stroke)->replayable = false;
+    // Dynamic brushes keep the size and opacity of every point.
+    if(brush->dynamics) add_command_value(*stroke,point,dynamics);
+    else add_command_point(*stroke,point);
+}
+
+// Paints the samples read this frame while one of the accepted buttons was down, in the order they were read,
+// so the stroke follows the mouse even when frames are slow.
+void paintSamples(CanvasShadow *canvas, RenderTexture2D *preview, StrokeBuffer *strokeBuffer, Command **stroke, Tools tool, const PointerSample *samples, int count,
+                  bool useLeft, bool useRight, Camera2D camera, Vector2 *lastMouse, Brush *brush, Color color)
+{
+    bool painted = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (!(useLeft && samples[i].left) && !(useRight && samples[i].right)) continue;
+        Vector2 point = GetScreenToWorld2D((Vector2){samples[i].x,samples[i].y},camera);
+        if (!strokeBuffer->active) begin_stroke_filter(&brush->filter);
+        // The stroke is recorded and painted along the smoothed path, so replaying it gives the same pixels.
+        point = filter_stroke_point(&brush->filter,point,samples[i].time);
+        float dynamics = brush->dynamics ? dabDynamics(samples[i].pressure,brush->filter.velocity) : 1.0f;
+        recordStroke(stroke,tool,brush,color,point,dynamics);
+        paint(canvas,preview,strokeBuffer,&point,lastMouse,brush,color,dynamics);
+        painted = true;
+    }
+
+    // The preview runs ahead of the stroke by about the time a frame takes to be shown, the canvas only gets the points read.
+    // Square brushes are predicted with a capsule as wide as the square, the prediction only lasts a frame.
+    if (painted)
+    {
+        float size = brush->size * brush->dabs.last.scale;
+        float radius = brush->mode == ROUND ? size : size / 2;
+        float offset = brush->mode == ROUND ? 0 : brush->size / 2;
+        Vector2 predicted = predict_stroke_point(&brush->filter,GetFrameTime());
+        preview_stroke_prediction(strokeBuffer,preview,(Vector2){brush->filter.value.x + offset,brush->filter.value.y + offset},
+                                  (Vector2){predicted.x + offset,predicted.y + offset},radius);
+    }
+    else clear_stroke_prediction(strokeBuffer,preview);
+}
+
+// Ends the stroke where the button was released. The samples read this frame before the release are painted,
+// then the last point read, which the smoothed path lags behind.
+void finishStroke(CanvasShadow *canvas, RenderTexture2D *preview, StrokeBuffer *strokeBuffer, Command **stroke, const PointerSample *samples, int count,
+                  Camera2D camera, Vector2 *lastMouse, Brush *brush)
+{
+    Color color = (*stroke)->colors[0];
+    int held = 0;
+    while (held < count && (samples[held].left || samples[held].right)) held++;
+    paintSamples(canvas,preview,strokeBuffer,stroke,(*stroke)->tool,samples,held,true,true,camera,lastMouse,brush,color);
+
+    Vector2 end = end_stroke_filter(&brush->filter);
+    if (!Vector2Equals(end,*lastMouse))
+    {
+        float dynamics = brush->dynamics ? brush->dabs.last.scale : 1.0f;
+        recordStroke(stroke,(*stroke)->tool,brush,color,end,dynamics);
+        paint(canvas,preview,strokeBuffer,&end,lastMouse,brush,color,dynamics);
+    }
+}
+
+void replayCommand(CanvasShadow *canvas, const Command *cmd)
+{
+    if(cmd->tool == COLOR_BUCKET){
+        fill(canvas,cmd->points[0],cmd->colors[0],cmd->size);
+        return;
+    }
+    if(cmd->tool == POLYGON){
+        Polygon replayedPolygon = {.num_of_vertices = cmd->point_count, .capacity = cmd->point_count, .vertices = cmd->points,
+                                   .outline_size = cmd->size, .has_outline = cmd->has_outline, .is_filled = cmd->is_filled, .smooth = cmd->smooth, .fill_rule = cmd->mode};
+        drawClosedPolygon(canvas,&replayedPolygon,cmd->colors[0],cmd->colors[1]);
+        return;
+    }
+    if(cmd->tool == TEXT_BOX){
+        Text replayedText = {.buffer = cmd->text, .font_size = cmd->size, .pos = cmd->points[0], .is_writing = false};
+        upload_shadow(canvas);
+        damage_canvas(canvas,textBounds(&replayedText));
+        DrawTextToScreen(canvas->target,&replayedText,cmd->colors[0]);
+        mark_canvas_drawn(canvas);
+        return;
+    }
+
+    if(cmd->tool == AIR_BRUSH && cmd->mode == SPRAY_DENSITY){
+        StrokeBuffer *strokeBuffer = stroke_buffer();
+        begin_stroke_buffer(strokeBuffer,canvas->target->texture.width,canvas->target->texture.height,cmd->colors[0]);
+        for(int i = 0; i < cmd->point_count; i++){
+            splat_gaussian(strokeBuffer,cmd->points[i],cmd->size,densityPeak(cmd->size,cmd->values[i]),i);
+        }
+        composite_stroke(strokeBuffer,canvas,NULL);
+        free_stroke_buffer(strokeBuffer);
+        return;
+    }
+    if(cmd->tool == AIR_BRUSH){
+        SprayRandom random;
+        seed_spray_random(&random,cmd->seed);
+        for(int i = 0; i < cmd->point_count; i++){
+            sprayAirbrush(canvas,&random,cmd->points[i],cmd->size,(int)cmd->values[i],cmd->colors[0]);
+        }
+        upload_shadow(canvas);
+        return;
+    }
+
+    Shape shapeInfo = {cmd->size,cmd->has_outline,cmd->is_filled,cmd->smooth};
+    Vector2 start = cmd->point_count > 0 ? cmd->points[0] : (Vector2){0,0};
+    Vector2 end = cmd->point_count > 1 ? cmd->points[1] : start;
+
+    if(cmd->tool == BRUSH || cmd->tool == ERASER){
+        DabStroke dabs;
+        StrokeBuffer *strokeBuffer = stroke_buffer();
+        begin_dab_stroke(&dabs);
+        begin_stroke_buffer(strokeBuffer,canvas->target->texture.width,canvas->target->texture.height,cmd->colors[0]);
+        for(int i = 0; i < cmd->point_count; i++){
+            float dynamics = cmd->values ? cmd->values[i] : 1.0f;
+            brushDraw(&dabs,strokeBuffer,(Dab){cmd->points[i],dynamics,dynamics},cmd->size,cmd->mode,cmd->spacing);
+        }
+        composite_stroke(strokeBuffer,canvas,NULL);
+        free_stroke_buffer(strokeBuffer);
+        return;
+    }
+    if(cmd->tool == RECTANGLE){
+        commitShape(canvas,&start,&end,cmd->colors[0],cmd->colors[1],shapeInfo,drawRec,rasterRec);
+        return;
+    }
+    if(cmd->tool == OVAL){
+        commitShape(canvas,&start,&end,cmd->colors[0],cmd->colors[1],shapeInfo,drawOval,rasterOval);
+        return;
+    }
+
+    begin_canvas_mode(canvas);
+    switch (cmd->tool)
+    {
+        case LINE:
+            damage_canvas(canvas,pointsBounds((Vector2[]){start,end},2,(int)cmd->size / 2 + 2));
+            drawRoundLine(start,end,cmd->size,cmd->colors[0]);
+            break;
+        case CURVE:
+            damage_canvas(canvas,splineBounds(cmd->points,cmd->point_count,cmd->size / 2 + 2));
+            DrawSplineCatmullRom(cmd->points,cmd->point_count,cmd->size,cmd->colors[0]);
+            break;
+        default:
+            break;
+    }
+    end_canvas_mode(canvas);
+}
 
 //GUI FUNCTIONS
 
@@ -872,16 +1223,28 @@ void brushSettingsGUI(void *tool, Rectangle GUIRec){
     Brush *brush = (Brush *)tool;
     DrawRectangleRec(GUIRec,MENU_GRAY);
     DrawRectangleLinesEx(GUIRec,1,GRAY);
+    GuiCheckBox((Rectangle){ GetScreenWidth() - 205,GetScreenHeight() - 150, 15, 15},"Dynamics",&brush->dynamics);
+    GuiSliderBar((Rectangle){ GetScreenWidth() - 180,GetScreenHeight() - 120, 130, 15 }, "Spacing",
+                 brush->spacing > 0 ? TextFormat("%.0f%%", brush->spacing * 100) : "Swept",&brush->spacing, 0, 1);
     GuiSliderBar((Rectangle){ GetScreenWidth() - 180,GetScreenHeight() - 60, 130, 15 }, "Size", TextFormat("%.0f", brush->size),&brush->size, 1, 120);
     const char *brushModeToggles = "CIRCLE;SQUARE"; 
-    GuiComboBox((Rectangle){GetScreenWidth() - 205,GetScreenHeight() - 90, 170, 15 },brushModeToggles,&brush->brushModeIndex);
+    GuiComboBox((Rectangle){GetScreenWidth() - 205,GetScreenHeight() - 90, 100, 15 },brushModeToggles,&brush->brushModeIndex);
     brush->mode = (BrushMode)brush->brushModeIndex;
+    bool smoothing = brush->smoothing;
+    GuiCheckBox((Rectangle){ GetScreenWidth() - 95,GetScreenHeight() - 90, 15, 15},"Smooth",&brush->smoothing);
+    if(brush->smoothing != smoothing){
+        if(brush->smoothing) one_euro_stroke_filter(&brush->filter);
+        else raw_stroke_filter(&brush->filter);
+    }
 }
 
 void airBrushSettingsGUI(void *tool, Rectangle GUIRec){
     AirBrush *airbrush = (AirBrush *)tool;
     DrawRectangleRec(GUIRec,MENU_GRAY);
     DrawRectangleLinesEx(GUIRec,1,GRAY);
+    const char *airBrushModeToggles = "DOTS;DENSITY";
+    GuiComboBox((Rectangle){GetScreenWidth() - 235,GetScreenHeight() - 120, 205, 15 },airBrushModeToggles,&airbrush->airBrushModeIndex);
+    airbrush->mode = (AirBrushMode)airbrush->airBrushModeIndex;
     GuiSliderBar((Rectangle){ GetScreenWidth() - 180,GetScreenHeight() - 90, 120, 15 }, "Radius", TextFormat("%.2f", airbrush->radius),&airbrush->radius, 1, 120);
     GuiSliderBar((Rectangle){ GetScreenWidth() - 180,GetScreenHeight() - 60, 120, 15 }, "Spray Rate", TextFormat("%.0f", airbrush->spray_rate),&airbrush->spray_rate, 1000,20000);
 }
@@ -901,6 +1264,7 @@ void shapeSettingsGUI(void *tool, Rectangle GUIRec){
     DrawRectangleLinesEx(GUIRec,1,GRAY);
     GuiCheckBox((Rectangle){ GetScreenWidth() - 220,GetScreenHeight() - 120, 20, 20},"Outline",&shape->has_outline);
     GuiCheckBox((Rectangle){ GetScreenWidth() - 220,GetScreenHeight() - 90, 20, 20},"Fill",&shape->is_filled);
+    GuiCheckBox((Rectangle){ GetScreenWidth() - 130,GetScreenHeight() - 120, 20, 20},"Smooth",&shape->smooth);
     GuiSliderBar((Rectangle){ GetScreenWidth() - 155,GetScreenHeight() - 60, 110, 20},"Outline Size",TextFormat("%.0f", shape->outline_size),&shape->outline_size,1,120);  
 }
 
@@ -910,6 +1274,10 @@ void polygonSettingsGUI(void *tool, Rectangle GUIRec){
     DrawRectangleLinesEx(GUIRec,1,GRAY);
     GuiCheckBox((Rectangle){ GetScreenWidth() - 220,GetScreenHeight() - 120, 20, 20},"Outline",&poly->has_outline);
     GuiCheckBox((Rectangle){ GetScreenWidth() - 220,GetScreenHeight() - 90, 20, 20},"Fill",&poly->is_filled);
+    GuiCheckBox((Rectangle){ GetScreenWidth() - 130,GetScreenHeight() - 120, 20, 20},"Smooth",&poly->smooth);
+    bool nonZero = poly->fill_rule == FILL_NON_ZERO;
+    GuiCheckBox((Rectangle){ GetScreenWidth() - 130,GetScreenHeight() - 90, 20, 20},"Non-zero",&nonZero);
+    poly->fill_rule = nonZero ? FILL_NON_ZERO : FILL_EVEN_ODD;
     GuiSliderBar((Rectangle){ GetScreenWidth() - 155,GetScreenHeight() - 60, 110, 20},"Outline Size",TextFormat("%.0f", poly->outline_size),&poly->outline_size,1,120);  
 }
 
@@ -920,6 +1288,13 @@ void magnifierSettingsGUI(void *tool, Rectangle GUIRec){
     GuiSliderBar((Rectangle){ GetScreenWidth() - 210,GetScreenHeight() - 60, 150, 20}, "Zoom",TextFormat("%.2fx", (*zoom_percentage)/100),zoom_percentage,10,800);
 }
 
+void fillSettingsGUI(void *tool, Rectangle GUIRec){
+    float *tolerance = (float *)tool;
+    DrawRectangleRec(GUIRec,MENU_GRAY);
+    DrawRectangleLinesEx(GUIRec,1,GRAY);
+    GuiSliderBar((Rectangle){ GetScreenWidth() - 195,GetScreenHeight() - 60, 150, 20}, "Tolerance",TextFormat("%.0f", (*tolerance)),tolerance,0,255);
+}
+
 void lineSettingsGUI(void *tool, Rectangle GUIRec){
     float *lineSize = (float *)tool;
     DrawRectangleRec(GUIRec,MENU_GRAY);
@@ -928,26 +1303,32 @@ void lineSettingsGUI(void *tool, Rectangle GUIRec){
 }
 
 
+// Reloads the preview, cleared, with the size of the canvas.
+void fitPreview(RenderTexture2D *canvas,RenderTexture2D *preview){
+    RenderTexture2D newPreview = LoadRenderTexture(canvas->texture.width,canvas->texture.height);
+    BeginTextureMode(newPreview);
+        ClearBackground(BLANK);
+    EndTextureMode();
+    UnloadRenderTexture(*preview);
+    *preview = newPreview;
+    previewDrawn = (Rectangle){0};
+}
+
 void resizeCanvas(RenderTexture2D *canvas,RenderTexture2D *preview,int widthIncrement, int heightIncrement, Color backgroundColor){
     int newWidth = canvas->texture.width + widthIncrement;
     int newHeight = canvas->texture.height + heightIncrement;
     newWidth = newWidth < 0 ? 0 : newWidth;
     newHeight = newHeight < 0 ? 0 : newHeight;
     RenderTexture2D newCanvas = LoadRenderTexture(newWidth,newHeight);
-    RenderTexture2D newPreview = LoadRenderTexture(newWidth,newHeight);
     BeginTextureMode(newCanvas);
         ClearBackground(backgroundColor);
         Rectangle source = {0,0,canvas->texture.width,-canvas->texture.height};
         Vector2 position = {0,0};
         DrawTextureRec(canvas->texture,source,position,WHITE);
     EndTextureMode();
-    BeginTextureMode(newPreview);
-        ClearBackground(BLANK);
-    EndTextureMode();
     UnloadRenderTexture(*canvas);
     *canvas = newCanvas;
-    UnloadRenderTexture(*preview);
-    *preview = newPreview;
+    fitPreview(canvas,preview);
 }
 
 void changeResizeSquaresPosition(Rectangle *resizeSquare, Rectangle *resizeHSquare, Rectangle *resizeVSquare, Vector2 canvasPos, int canvasWidth, int canvasHeight, float cameraZoom){
@@ -967,11 +1348,12 @@ void handleResizeSquaresZoom(Rectangle *resizeSquare, Rectangle *resizeHSquare,
 }
 
 
-void savingImage(RenderTexture2D *canvas,char *path, char* filename, Format fileformat){
+// Takes a snapshot of the canvas and starts writing it in the background, returns true if the export started.
+bool savingImage(ImageExporter *exporter,CanvasShadow *canvas,char *path, char* filename, Format fileformat){
 
     if(!DirectoryExists(path)){
         printf("Path doesn't exist");
-        return;
+        return false;
     }
 
     const char *extension = "";
@@ -985,6 +1367,13 @@ void savingImage(RenderTexture2D *canvas,char *path, char* filename, Format file
             break;
         case BMP:
             extension = ".bmp";
+            break;
+        case QOI:
+            extension = ".qoi";
+            break;
+        case RAW_RGBA:
+            extension = ".rgba";
+            break;
         default:
             break;
     }
@@ -994,21 +1383,50 @@ void savingImage(RenderTexture2D *canvas,char *path, char* filename, Format file
     sprintf(fullPath,"%s%c%s%s",path,PATH_SEPARATOR,filename,extension);
     if (!fullPath) {
         printf("Failed at allocating memory for full Path string\n");
-        return;
+        return false;
     }
-    Image image = LoadImageFromTexture(canvas->texture);
-    ImageFlipVertical(&image);   
-    if(!ExportImage(image,fullPath)){
-        printf("Failed to save image!\n");
+    // Only the copy is made here, it's kept bottom-up and encoding it is left to the export thread.
+    sync_shadow(canvas);
+    Image image = ImageCopy(canvas->image);
+    bool started = start_export(exporter,image,fullPath,true);
+    if(!started){
+        printf("Failed to start saving image!\n");
+        UnloadImage(image);
     }
-    UnloadImage(image);
     free(fullPath);
+    return started;
+}
+
+// Returns the image at path as 8 bit RGBA with rows top-down. QOI and raw RGBA files are read by imagewriter.c,
+// the other formats by raylib. Its data is NULL if it couldn't be read.
+Image loadCanvasImage(const char *path, Format *fileformat){
+    Image image = {0};
+    if(IsFileExtension(path,".qoi")){
+        image = load_qoi(path);
+        *fileformat = QOI;
+    }
+    else if(IsFileExtension(path,".rgba")){
+        image = load_raw_rgba(path);
+        *fileformat = RAW_RGBA;
+    }
+    else{
+        image = LoadImage(path);
+        if(image.data) ImageFormat(&image,PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        if(IsFileExtension(path,".jpg;.jpeg")) *fileformat = JPEG;
+        else if(IsFileExtension(path,".bmp")) *fileformat = BMP;
+        else *fileformat = PNG;
+    }
+    return image;
 }
 
 //MAIN
 
-int main(void)
+int main(int argc, char **argv)
 {
+    Settings *appSettings = settings();
+    load_settings_file(appSettings,TextFormat("%s%s",GetApplicationDirectory(),SETTINGS_FILE_NAME));
+    parse_settings_args(appSettings,argc,argv);
+
     const int screenWidth = 800;
     const int screenHeight = 600;
     
@@ -1023,6 +1441,7 @@ int main(void)
     strcpy(saving_path, get_pictures_path());
     char *image_name = malloc(1024);
     int file_format = 0;
+    int png_level = PNG_BALANCED;
 
     sprintf(image_name,"untitled");
 
@@ -1083,6 +1502,9 @@ int main(void)
         ClearBackground(BLANK);  
     EndTextureMode();
 
+    // CPU copy of the canvas, read by the tools and the history instead of reading the canvas back from the GPU.
+    CanvasShadow *canvasShadow = canvas_shadow(&canvas);
+
     Rectangle resizeSquare = (Rectangle){canvasWidth,canvasHeight,RESIZE_SQUARE_SIDE_SIZE,RESIZE_SQUARE_SIDE_SIZE};
     Rectangle resizeHorizontallySquare = (Rectangle){canvasWidth,canvasHeight/2-RESIZE_SQUARE_SIDE_SIZE/2,RESIZE_SQUARE_SIDE_SIZE,RESIZE_SQUARE_SIDE_SIZE};
     Rectangle resizeVerticallySquare = (Rectangle){canvasWidth/2-RESIZE_SQUARE_SIDE_SIZE/2,canvasHeight,RESIZE_SQUARE_SIDE_SIZE,RESIZE_SQUARE_SIDE_SIZE};
@@ -1096,6 +1518,10 @@ int main(void)
     bool colorPickerOpen = false;
 
     bool saving = false;
+    ImageExporter *exporter = image_exporter();
+    ExportState exportResult = EXPORT_IDLE;
+    double exportFinishedTime = 0;
+    float exportProgress = 0;
 
     // TOOLS
     Brush *currentBrush = brush(5,ROUND);
@@ -1110,6 +1536,8 @@ int main(void)
 
     float lineSize = 5;
 
+    float fillTolerance = 0;
+
     Vector2 lastMouse = { -1, -1 };
 
     SetTargetFPS(0); 
@@ -1148,7 +1576,7 @@ int main(void)
         [BRUSH] = currentBrush,
         [ERASER] = currentEraser,
         [AIR_BRUSH] = currentAirBrush,
-        [COLOR_BUCKET] = NULL,
+        [COLOR_BUCKET] = &fillTolerance,
         [COLOR_PICKER] = NULL,
         [TEXT_BOX] = currentText,
         [MAGNIFIER] = &zoom_percentage,
@@ -1163,7 +1591,7 @@ int main(void)
     GUISettingFunctions[BRUSH] =  brushSettingsGUI;
     GUISettingFunctions[ERASER] = brushSettingsGUI;
     GUISettingFunctions[AIR_BRUSH] = airBrushSettingsGUI;
-    GUISettingFunctions[COLOR_BUCKET] = NULL;
+    GUISettingFunctions[COLOR_BUCKET] = fillSettingsGUI;
     GUISettingFunctions[COLOR_PICKER] = NULL;
     GUISettingFunctions[TEXT_BOX] = textSettingsGUI;
     GUISettingFunctions[MAGNIFIER] = magnifierSettingsGUI;
@@ -1177,7 +1605,30 @@ int main(void)
     void *currentToolPtr = currentBrush;
 
     DoublyLinkedList *history = doublylinkedlist();
-    add_node(history,canvas.texture);
+    set_history_budget(history,appSettings->history_budget);
+    set_replay_function(history,replayCommand);
+    add_node(history,canvasShadow,NULL);
+
+    // Command of the brush, eraser or airbrush stroke being drawn, added to the history once every mouse button is released.
+    Command *stroke = NULL;
+    // Coverage of the brush or eraser stroke being drawn, blended into the canvas when the stroke is added to the history.
+    StrokeBuffer *strokeBuffer = stroke_buffer();
+
+    // Mouse samples read since the last frame, strokes use all of them instead of the position at the start of the frame.
+    InputSampler *inputSampler = input_sampler(GetWindowHandle());
+    PointerSample pointerSamples[MAX_POINTER_SAMPLES];
+
+    // RECOVERY
+    // A recovery file left behind means the last session didn't close cleanly, its canvas is offered back before anything is drawn.
+    char *recoveryPath = malloc(1024);
+    snprintf(recoveryPath,1024,"%s%s",GetApplicationDirectory(),AUTOSAVE_FILE_NAME);
+    bool recovering = FileExists(recoveryPath);
+    bool restoringCanvas = false;
+    bool discardingCanvas = false;
+    Autosave *autosaver = NULL;
+    if(!recovering && appSettings->autosave_interval > 0)
+        autosaver = autosave(recoveryPath);
+    double lastAutosaveTime = GetTime();
 
     while (!WindowShouldClose())
     {
@@ -1197,10 +1648,10 @@ int main(void)
         Rectangle VerticalScrollBar = {GetScreenWidth() - 10, canvasPos.y,10,GetScreenHeight()-canvasPos.y-30};
 
         Rectangle GUIRecs[MAX_TOOLS_COUNT] = {
-            [BRUSH] = (Rectangle){GetScreenWidth() - 220,GetScreenHeight() - 105,200,70},
-            [ERASER] = (Rectangle){GetScreenWidth() - 220,GetScreenHeight() - 105,200,70},
-            [AIR_BRUSH] = (Rectangle){GetScreenWidth() - 250,GetScreenHeight() - 105,235,70},
-            [COLOR_BUCKET] = (Rectangle){0},
+            [BRUSH] = (Rectangle){GetScreenWidth() - 220,GetScreenHeight() - 165,200,130},
+            [ERASER] = (Rectangle){GetScreenWidth() - 220,GetScreenHeight() - 165,200,130},
+            [AIR_BRUSH] = (Rectangle){GetScreenWidth() - 250,GetScreenHeight() - 135,235,100},
+            [COLOR_BUCKET] = (Rectangle){GetScreenWidth() - 250,GetScreenHeight() - 70,235,35},
             [COLOR_PICKER] = (Rectangle){0},
             [TEXT_BOX] = (Rectangle){GetScreenWidth() - 250,GetScreenHeight() - 70,235,35},
             [MAGNIFIER] = (Rectangle){GetScreenWidth() - 250,GetScreenHeight() - 70,235,35},
@@ -1215,6 +1666,10 @@ int main(void)
         Vector2 mouse = GetMousePosition();
         Vector2 mouseInCanvas = GetScreenToWorld2D(GetMousePosition(), camera);
 
+        if(!is_input_threaded(inputSampler))
+            push_pointer_sample(inputSampler,(PointerSample){mouse.x,mouse.y,IsMouseButtonDown(MOUSE_BUTTON_LEFT),IsMouseButtonDown(MOUSE_BUTTON_RIGHT),GetTime(),NO_PRESSURE});
+        int pointerSampleCount = take_pointer_samples(inputSampler,pointerSamples,MAX_POINTER_SAMPLES);
+
         if(
             isInsideBounds(canvas.texture.width,canvas.texture.height,mouseInCanvas.x,mouseInCanvas.y) 
             && !CheckCollisionPointRec(mouse,menuRec) 
@@ -1226,6 +1681,7 @@ int main(void)
             && !colorPickerOpen 
             && !resizingCanvas
             && !saving
+            && !recovering
         )
             isMouseOverCanvas = true;
         else
@@ -1276,8 +1732,10 @@ int main(void)
             }
             if(IsMouseButtonReleased(MOUSE_BUTTON_LEFT)){
                 resizeCanvas(&canvas,&preview,widthIncrement,heightIncrement,backgroundColor);
+                mark_canvas_drawn(canvasShadow);
                 canvasWidth = canvas.texture.width;
                 canvasHeight = canvas.texture.height;
+                add_node(history,canvasShadow,NULL);
                 changeResizeSquaresPosition(&resizeSquare,&resizeHorizontallySquare,&resizeVerticallySquare,canvasPos,canvasWidth,canvasHeight,camera.zoom);
                 resizingCanvas = false;
                 resizingWidth = false;
@@ -1287,6 +1745,70 @@ int main(void)
             }
         }
 
+        // OPEN
+        // An image dropped on the window replaces the canvas as a step of the history, and is saved back under its name and format.
+        if(IsFileDropped()){
+            FilePathList droppedFiles = LoadDroppedFiles();
+            if(droppedFiles.count > 0 && stroke == NULL && !resizingCanvas && !recovering){
+                Format openedFormat = PNG;
+                Image opened = loadCanvasImage(droppedFiles.paths[0],&openedFormat);
+                if(opened.data){
+                    ImageFlipVertical(&opened);
+                    load_shadow_pixels(canvasShadow,opened.data,opened.width,opened.height);
+                    add_node(history,canvasShadow,NULL);
+                    UnloadImage(opened);
+                    snprintf(saving_path,1024,"%s",GetDirectoryPath(droppedFiles.paths[0]));
+                    snprintf(image_name,1024,"%s",GetFileNameWithoutExt(droppedFiles.paths[0]));
+                    file_format = openedFormat;
+                }
+                else fprintf(stderr, "Warning: %s couldn't be opened.\n",droppedFiles.paths[0]);
+            }
+            UnloadDroppedFiles(droppedFiles);
+        }
+
+        // Undoing or redoing a resize reloads the canvas with its other size.
+        if(canvas.texture.width != canvasWidth || canvas.texture.height != canvasHeight){
+            fitPreview(&canvas,&preview);
+            canvasWidth = canvas.texture.width;
+            canvasHeight = canvas.texture.height;
+            changeResizeSquaresPosition(&resizeSquare,&resizeHorizontallySquare,&resizeVerticallySquare,canvasPos,canvasWidth,canvasHeight,camera.zoom);
+        }
+
+        if(restoringCanvas || discardingCanvas){
+            if(restoringCanvas){
+                Image recovered = load_recovery(recoveryPath);
+                if(recovered.data){
+                    resizeCanvas(&canvas,&preview,recovered.width - canvas.texture.width,recovered.height - canvas.texture.height,backgroundColor);
+                    mark_canvas_drawn(canvasShadow);
+                    canvasWidth = canvas.texture.width;
+                    canvasHeight = canvas.texture.height;
+                    changeResizeSquaresPosition(&resizeSquare,&resizeHorizontallySquare,&resizeVerticallySquare,canvasPos,canvasWidth,canvasHeight,camera.zoom);
+                    memcpy(sync_shadow(canvasShadow),recovered.data,(size_t)canvasWidth * canvasHeight * sizeof(Color));
+                    mark_shadow_changed(canvasShadow,(Rectangle){0,0,canvasWidth,canvasHeight});
+                    upload_shadow(canvasShadow);
+                    add_node(history,canvasShadow,NULL);
+                    UnloadImage(recovered);
+                }
+                else fprintf(stderr, "Warning: nothing could be recovered from %s.\n",recoveryPath);
+            }
+            // A restored canvas stays in the recovery file until the first autosave replaces it.
+            if(discardingCanvas || appSettings->autosave_interval <= 0) remove(recoveryPath);
+            if(appSettings->autosave_interval > 0) autosaver = autosave(recoveryPath);
+            lastAutosaveTime = GetTime();
+            recovering = false;
+            restoringCanvas = false;
+            discardingCanvas = false;
+        }
+
+        if(stroke != NULL && !IsMouseButtonDown(MOUSE_LEFT_BUTTON) && !IsMouseButtonDown(MOUSE_RIGHT_BUTTON)){
+            if(stroke->tool == BRUSH || stroke->tool == ERASER)
+                finishStroke(canvasShadow,&preview,strokeBuffer,&stroke,pointerSamples,pointerSampleCount,camera,&lastMouse,
+                             stroke->tool == BRUSH ? currentBrush : currentEraser);
+            composite_stroke(strokeBuffer,canvasShadow,&preview);
+            add_node(history,canvasShadow,stroke);
+            stroke = NULL;
+        }
+
         int increment = GetMouseWheelMove();
         switch (currentTool)
         {
@@ -1294,16 +1816,13 @@ int main(void)
                 if(isMouseOverCanvas){
                     if (IsMouseButtonDown(MOUSE_LEFT_BUTTON))
                     {
-                        paint(&canvas,&mouseInCanvas,&lastMouse,currentBrush,primaryColor);
+                        paintSamples(canvasShadow,&preview,strokeBuffer,&stroke,BRUSH,pointerSamples,pointerSampleCount,true,false,camera,&lastMouse,currentBrush,primaryColor);
                     }
                     else if(IsMouseButtonDown(MOUSE_RIGHT_BUTTON) )
                     {  
-                        paint(&canvas,&mouseInCanvas,&lastMouse,currentBrush,secondaryColor);
+                        paintSamples(canvasShadow,&preview,strokeBuffer,&stroke,BRUSH,pointerSamples,pointerSampleCount,false,true,camera,&lastMouse,currentBrush,secondaryColor);
                     }
                     else{
-                        if(IsMouseButtonReleased(MOUSE_RIGHT_BUTTON) || IsMouseButtonReleased(MOUSE_LEFT_BUTTON)){
-                            add_node(history,canvas.texture);
-                        }
                         lastMouse.x = -1;
                         lastMouse.y = -1;
                     }
@@ -1317,12 +1836,9 @@ int main(void)
                 if(isMouseOverCanvas){
                     if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) || IsMouseButtonDown(MOUSE_RIGHT_BUTTON))
                     {
-                        paint(&canvas,&mouseInCanvas,&lastMouse,currentEraser,backgroundColor);
+                        paintSamples(canvasShadow,&preview,strokeBuffer,&stroke,ERASER,pointerSamples,pointerSampleCount,true,true,camera,&lastMouse,currentEraser,backgroundColor);
                     }
                     else{
-                        if(IsMouseButtonReleased(MOUSE_RIGHT_BUTTON) || IsMouseButtonReleased(MOUSE_LEFT_BUTTON)){
-                            add_node(history,canvas.texture);
-                        }
                         lastMouse.x = -1;
                         lastMouse.y = -1;
                     }
@@ -1334,40 +1850,41 @@ int main(void)
                 break;
             case COLOR_BUCKET:
                 if(isMouseOverCanvas){
-                    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                        fill(&canvas,mouseInCanvas,primaryColor);
-                        add_node(history,canvas.texture);
-                    }
-                    else if(IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)){
-                        fill(&canvas,mouseInCanvas,secondaryColor);
-                        add_node(history,canvas.texture);
+                    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) || IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)){
+                        Color fillColor = IsMouseButtonPressed(MOUSE_LEFT_BUTTON) ? primaryColor : secondaryColor;
+                        Command *fillCommand = command(COLOR_BUCKET,fillColor,BLANK,(int)fillTolerance);
+                        add_command_point(fillCommand,mouseInCanvas);
+                        fill(canvasShadow,mouseInCanvas,fillColor,fillTolerance);
+                        add_node(history,canvasShadow,fillCommand);
                     }
                 }
                 break;
             case COLOR_PICKER:
                 if(isMouseOverCanvas){
                     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                        Image canvasImage = LoadImageFromTexture(canvas.texture);
-                        primaryColor = GetImageColor(canvasImage,mouseInCanvas.x,canvasHeight - mouseInCanvas.y - 1);
-                        UnloadImage(canvasImage);
+                        primaryColor = get_shadow_color(canvasShadow,mouseInCanvas.x,mouseInCanvas.y);
                     }
                     else if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)){
-                        Image canvasImage = LoadImageFromTexture(canvas.texture);
-                        secondaryColor = GetImageColor(canvasImage,mouseInCanvas.x,canvasHeight - mouseInCanvas.y - 1);
-                        UnloadImage(canvasImage);
+                        secondaryColor = get_shadow_color(canvasShadow,mouseInCanvas.x,mouseInCanvas.y);
                     }
                 }
                 break;
             case AIR_BRUSH:
                 if(isMouseOverCanvas){
-                    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-                        DrawAirbrush(&canvas, mouseInCanvas, primaryColor,currentAirBrush->radius,currentAirBrush->spray_rate,&dotAccumulator); // radius 20, density 100
-                    }
-                    if (IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) {
-                        DrawAirbrush(&canvas, mouseInCanvas, secondaryColor,currentAirBrush->radius,currentAirBrush->spray_rate,&dotAccumulator); // radius 20, density 100
+                    if (stroke == NULL && (IsMouseButtonDown(MOUSE_LEFT_BUTTON) || IsMouseButtonDown(MOUSE_RIGHT_BUTTON))) {
+                        // Every stroke gets its own seed, which is all the history needs to spray the same dots again.
+                        stroke = command(AIR_BRUSH,IsMouseButtonDown(MOUSE_LEFT_BUTTON) ? primaryColor : secondaryColor,secondaryColor,currentAirBrush->radius);
+                        stroke->seed = (unsigned int)GetRandomValue(0,0xFFFF) << 16 | (unsigned int)GetRandomValue(0,0xFFFF);
+                        stroke->mode = currentAirBrush->mode;
+                        seed_spray_random(&currentAirBrush->random,stroke->seed);
                     }
-                    if(IsMouseButtonReleased(MOUSE_RIGHT_BUTTON) || IsMouseButtonReleased(MOUSE_LEFT_BUTTON)){
-                            add_node(history,canvas.texture);
+                    // The mode is kept until the stroke ends.
+                    Color sprayColor = IsMouseButtonDown(MOUSE_LEFT_BUTTON) ? primaryColor : secondaryColor;
+                    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) || IsMouseButtonDown(MOUSE_RIGHT_BUTTON)) {
+                        if (stroke->mode == SPRAY_DENSITY)
+                            DrawDensityAirbrush(canvasShadow,&preview,strokeBuffer,stroke,currentAirBrush,mouseInCanvas,sprayColor);
+                        else
+                            DrawAirbrush(canvasShadow,stroke,currentAirBrush,mouseInCanvas,sprayColor,&dotAccumulator);
                     }
                 }
                 if(increment != 0)
@@ -1384,12 +1901,16 @@ int main(void)
                             currentText->pos = mouseInCanvas;
                         }
                         else{
-                            BeginTextureMode(preview);
-                                ClearBackground(BLANK);  
-                            EndTextureMode();
+                            clearPreview(&preview);
+                            upload_shadow(canvasShadow);
+                            damage_canvas(canvasShadow,textBounds(currentText));
                             DrawTextToScreen(&canvas,currentText,primaryColor);
+                            mark_canvas_drawn(canvasShadow);
+                            Command *textCommand = command(TEXT_BOX,primaryColor,BLANK,currentText->font_size);
+                            add_command_point(textCommand,currentText->pos);
+                            set_command_text(textCommand,currentText->buffer);
                             createNewTextBuffer(currentText);   
-                            add_node(history,canvas.texture);   
+                            add_node(history,canvasShadow,textCommand);
                         }
                     }
                 }
@@ -1430,37 +1951,37 @@ int main(void)
                 handleResizeSquaresZoom(&resizeSquare,&resizeHorizontallySquare,&resizeVerticallySquare,camera.zoom);
                 break;
             case LINE:
-                drawLine(MOUSE_LEFT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,primaryColor,lineSize,isMouseOverCanvas,history);
-                drawLine(MOUSE_RIGHT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,secondaryColor,lineSize,isMouseOverCanvas,history);
+                drawLine(MOUSE_LEFT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,primaryColor,lineSize,isMouseOverCanvas,history);
+                drawLine(MOUSE_RIGHT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,secondaryColor,lineSize,isMouseOverCanvas,history);
                 if(increment != 0)
                 {
                     lineSize = changeSize(lineSize, increment);
                 }
                 break;
             case CURVE:
-                drawSpline(MOUSE_BUTTON_LEFT,&canvas,&preview,&lastMouse,&mouseInCanvas,primaryColor,currentSpline,isMouseOverCanvas,history);
-                drawSpline(MOUSE_BUTTON_RIGHT,&canvas,&preview,&lastMouse,&mouseInCanvas,secondaryColor,currentSpline,isMouseOverCanvas,history);
+                drawSpline(MOUSE_BUTTON_LEFT,canvasShadow,&preview,&lastMouse,&mouseInCanvas,primaryColor,currentSpline,isMouseOverCanvas,history);
+                drawSpline(MOUSE_BUTTON_RIGHT,canvasShadow,&preview,&lastMouse,&mouseInCanvas,secondaryColor,currentSpline,isMouseOverCanvas,history);
                 break;
             case RECTANGLE:
-                drawShape(MOUSE_LEFT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,*currentRec,drawRec,isMouseOverCanvas,history);
-                drawShape(MOUSE_RIGHT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,*currentRec,drawRec,isMouseOverCanvas,history);
+                drawShape(MOUSE_LEFT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,*currentRec,RECTANGLE,drawRec,rasterRec,isMouseOverCanvas,history);
+                drawShape(MOUSE_RIGHT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,*currentRec,RECTANGLE,drawRec,rasterRec,isMouseOverCanvas,history);
                 if(increment != 0)
                 {
                     currentRec->outline_size = changeSize(currentRec->outline_size, increment);
                 }
                 break;
             case OVAL:
-                drawShape(MOUSE_LEFT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,*currentOval,drawOval,isMouseOverCanvas,history);
-                drawShape(MOUSE_RIGHT_BUTTON,&canvas,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,*currentOval,drawOval,isMouseOverCanvas,history);
+                drawShape(MOUSE_LEFT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,*currentOval,OVAL,drawOval,rasterOval,isMouseOverCanvas,history);
+                drawShape(MOUSE_RIGHT_BUTTON,canvasShadow,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,*currentOval,OVAL,drawOval,rasterOval,isMouseOverCanvas,history);
                 break;
             case POLYGON:
                 if(isMouseOverCanvas){
                     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-                        drawPolygon(&canvas,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,currentPoly,history);
+                        drawPolygon(canvasShadow,&preview,&lastMouse,&mouseInCanvas,primaryColor,secondaryColor,currentPoly,history);
                     }
                     else if(IsMouseButtonPressed(MOUSE_RIGHT_BUTTON))
                     {
-                        drawPolygon(&canvas,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,currentPoly,history);
+                        drawPolygon(canvasShadow,&preview,&lastMouse,&mouseInCanvas,secondaryColor,primaryColor,currentPoly,history);
                     }
                 }
                 break;
@@ -1468,6 +1989,15 @@ int main(void)
                 break;
         }
 
+        // AUTOSAVE
+        // Only between strokes, so a stroke is never saved half drawn. The tiles are copied here and written by the autosave thread,
+        // an autosave still being written is tried again on the next frame.
+        if(autosaver && stroke == NULL && !IsMouseButtonDown(MOUSE_LEFT_BUTTON) && !IsMouseButtonDown(MOUSE_RIGHT_BUTTON)
+           && GetTime() - lastAutosaveTime >= appSettings->autosave_interval){
+            if(autosave_canvas(autosaver,canvasShadow))
+                lastAutosaveTime = GetTime();
+        }
+
         BeginDrawing();
 
         ClearBackground(RAYWHITE);
@@ -1511,9 +2041,7 @@ int main(void)
             if(GuiButton(toolSquares[i],str)){
                 if(currentTool == POLYGON && i != POLYGON){
                     // RESETS POLYGON TO THE INITIAL STATE WHERE IT HAS NO VERTICES AND ERASES ANY EDGE THAT WAS DRAWN IN THE PREVIEW.
-                    BeginTextureMode(preview);
-                    ClearBackground(BLANK);
-                    EndTextureMode();
+                    clearPreview(&preview);
                     createNewVertices(currentPoly);
                 }
                 currentTool = i;
@@ -1531,6 +2059,20 @@ int main(void)
         GuiLabel((Rectangle){10,GetScreenHeight() - 15,10,10},TextFormat("#%d#",ICON_CURSOR_POINTER));
         if(isMouseOverCanvas)
             DrawTextEx(GetFontDefault(), TextFormat("%d, %d px",(int)mouseInCanvas.x,(int)mouseInCanvas.y),(Vector2){40,GetScreenHeight() - 15},10, 2,DARKGRAY);
+        DrawTextEx(GetFontDefault(), TextFormat("History: %d steps, %.1f MB",history->count,get_history_usage(history) / (1024.0f * 1024.0f)),(Vector2){GetScreenWidth() - 200,GetScreenHeight() - 15},10, 2,DARKGRAY);
+
+        // EXPORT PROGRESS
+        ExportState exportState = poll_export(exporter,&exportProgress);
+        if(exportState == EXPORT_DONE || exportState == EXPORT_FAILED){
+            exportResult = exportState;
+            exportFinishedTime = GetTime();
+        }
+        if(exportState == EXPORT_RUNNING){
+            DrawTextEx(GetFontDefault(), TextFormat("Saving image... %d%%",(int)(exportProgress * 100)),(Vector2){GetScreenWidth()/2 - 60,GetScreenHeight() - 15},10, 2,DARKGRAY);
+        }
+        else if(exportResult != EXPORT_IDLE && GetTime() - exportFinishedTime < EXPORT_MESSAGE_TIME){
+            DrawTextEx(GetFontDefault(), exportResult == EXPORT_DONE ? "Image saved" : "Failed to save image!",(Vector2){GetScreenWidth()/2 - 60,GetScreenHeight() - 15},10, 2,exportResult == EXPORT_DONE ? DARKGRAY : MAROON);
+        }
 
         if (GUISettingFunctions[currentTool]){
             GUISettingFunctions[currentTool](currentToolPtr, GUIRecs[currentTool]);
@@ -1538,36 +2080,16 @@ int main(void)
 
         //UNDO
         if(GuiButton(Undo,TextFormat("#%d#",ICON_UNDO))){
-            previous_node(history);
-
-            BeginTextureMode(canvas);
-                ClearBackground(backgroundColor);
-                DrawTextureRec(
-                    history->current->value,
-                    (Rectangle){0,0,history->current->value.width,-history->current->value.height},
-                    (Vector2){0,0},
-                    WHITE
-                );
-            EndTextureMode();
+            previous_node(history,canvasShadow);
         }
 
         //REDO
         if(GuiButton(Redo,TextFormat("#%d#",ICON_REDO))){
-            next_node(history);
-
-            BeginTextureMode(canvas);
-                ClearBackground(backgroundColor);
-                DrawTextureRec(
-                    history->current->value,
-                    (Rectangle){0,0,history->current->value.width,-history->current->value.height},
-                    (Vector2){0,0},
-                    WHITE
-                );
-            EndTextureMode();
+            next_node(history,canvasShadow);
         }
 
         if(saving){
-            Rectangle windowBox = {GetScreenWidth()/2 - 250,GetScreenHeight()/2 - 125,500,250};
+            Rectangle windowBox = {GetScreenWidth()/2 - 250,GetScreenHeight()/2 - 145,500,290};
             if(GuiWindowBox(windowBox,"Save As")){
                 saving = false;
             };
@@ -1594,16 +2116,40 @@ int main(void)
             GuiTextBox(nameTextBox,image_name,1023,writing_name);
             DrawText("File Format: ",windowBox.x+20,windowBox.y+160,20,GRAY);
             Rectangle fileFormatToggle = {windowBox.x + 150,windowBox.y+150,60,30};
-            GuiToggleGroup(fileFormatToggle,".PNG;.JPEG;.BMP",&file_format);
+            GuiToggleGroup(fileFormatToggle,".PNG;.JPEG;.BMP;.QOI;.RGBA",&file_format);
+            if(file_format == PNG){
+                DrawText("Compression: ",windowBox.x+20,windowBox.y+200,20,GRAY);
+                Rectangle pngLevelToggle = {windowBox.x + 150,windowBox.y+190,60,30};
+                GuiToggleGroup(pngLevelToggle,"Fast;Balanced;Small",&png_level);
+            }
             Rectangle saveButton = {windowBox.x + windowBox.width/2 - 50,windowBox.y+windowBox.height - 40,100,30};
-            if(GuiButton(saveButton,"SAVE")){
-                printf("%d",file_format);
-                savingImage(&canvas,saving_path,image_name,file_format);
-                saving = false;
+            // Only one image is written at a time, the button is off until the last one is saved.
+            if(exportState == EXPORT_RUNNING) GuiDisable();
+            if(GuiButton(saveButton,exportState == EXPORT_RUNNING ? "SAVING..." : "SAVE")){
+                set_export_png_level(exporter,png_level);
+                if(savingImage(exporter,canvasShadow,saving_path,image_name,file_format))
+                    saving = false;
             };
+            GuiEnable();
 
         }
 
+        if(recovering){
+            Rectangle windowBox = {GetScreenWidth()/2 - 200,GetScreenHeight()/2 - 80,400,160};
+            // Closing the window keeps the recovery file, which is offered again on the next start.
+            if(GuiWindowBox(windowBox,"Recover Canvas")){
+                recovering = false;
+            }
+            DrawText("C-Paint didn't close properly last time.",windowBox.x+20,windowBox.y+45,10,DARKGRAY);
+            DrawText("Do you want to restore the autosaved canvas?",windowBox.x+20,windowBox.y+65,10,DARKGRAY);
+            if(GuiButton((Rectangle){windowBox.x + windowBox.width/2 - 110,windowBox.y+windowBox.height - 45,100,30},"RESTORE")){
+                restoringCanvas = true;
+            }
+            if(GuiButton((Rectangle){windowBox.x + windowBox.width/2 + 10,windowBox.y+windowBox.height - 45,100,30},"DISCARD")){
+                discardingCanvas = true;
+            }
+        }
+
         if(colorPickerOpen){
             if(GuiWindowBox((Rectangle){GetScreenWidth()/2 - 150,GetScreenHeight()/2 - 150,300,300},"Change Color")){
                 colorPickerOpen = false;
@@ -1642,11 +2188,21 @@ int main(void)
     freeShape(currentOval);
     freePolygon(currentPoly);
     freeSpline(currentSpline);
+    free_command(stroke);
+    free_stroke_buffer(strokeBuffer);
+    free_input_sampler(inputSampler);
+    // Writes the last autosave, then removes the recovery file since the program closes cleanly.
+    if(autosaver) free_autosave(autosaver);
+    free(recoveryPath);
+    // Waits for an image that is still being saved.
+    free_image_exporter(exporter);
     free_list(history);
+    free_shadow(canvasShadow);
     UnloadRenderTexture(canvas);
     UnloadRenderTexture(preview);
     free(saving_path);
     free(image_name);
+    free_settings(appSettings);
     CloseWindow();
 
     return 0;
@@ -0,0 +1,834 @@
+#include "pngwriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "threads.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Filtered bytes compressed by a thread at a time, whole rows are taken so a band can be a little larger.
+#define PNG_BAND_BYTES (256 * 1024)
+// Symbols in a deflate block, every block gets Huffman codes built from its own symbols.
+#define BLOCK_SYMBOLS 16384
+
+#define WINDOW_SIZE 32768
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define MAX_CODE_LENGTH 15
+#define MAX_CODE_LENGTH_CODE 7
+#define LITLEN_CODES 286
+#define DISTANCE_CODES 30
+#define CODE_LENGTH_CODES 19
+#define END_OF_BLOCK 256
+#define ADLER_BASE 65521
+
+// How hard each level looks for matches: entries of a hash chain visited, length after which the search stops,
+// whether a match is put off when the next byte starts a longer one, and the longest match whose bytes are all hashed.
+typedef struct
+{
+    int chain;
+    int nice;
+    bool lazy;
+    int insert_limit;
+
+} MatchParameters;
+
+static const MatchParameters LEVELS[] = {
+    {4, 32, false, 16},
+    {32, 128, true, MAX_MATCH},
+    {256, MAX_MATCH, true, MAX_MATCH}
+};
+
+static const unsigned short LENGTH_BASE[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const unsigned char LENGTH_EXTRA[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const unsigned short DISTANCE_BASE[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const unsigned char DISTANCE_EXTRA[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+static const unsigned char CODE_LENGTH_ORDER[CODE_LENGTH_CODES] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+
+// Code of every match length and distance, distances up to 256 are looked up by distance - 1 and the rest by 256 + (distance - 1) / 128.
+// They are filled by write_png() before its threads start.
+static unsigned char lengthCodes[MAX_MATCH + 1];
+static unsigned char distanceCodes[512];
+static uint32_t crcTable[256];
+static bool tablesReady = false;
+
+// Definition of a Symbol of a deflate block, a literal byte when distance is 0, otherwise a match of length bytes.
+typedef struct
+{
+    unsigned short length;
+    unsigned short distance;
+
+} Symbol;
+
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    uint64_t bits;
+    int count;
+
+} BitWriter;
+
+// Definition of a Band, its rows and, once done is set, the compressed piece of the zlib stream, the adler32 of its filtered bytes and the crc32 of its IDAT chunk.
+typedef struct
+{
+    int first_row;
+    int last_row;
+    unsigned char *data;
+    size_t size;
+    uint32_t adler;
+    uint32_t crc;
+    bool done;
+    bool failed;
+
+} Band;
+
+// State shared by the threads of one write_png() call, next_band and the done flags of the bands are protected by lock.
+typedef struct
+{
+    ImageRows rows;
+    int width;
+    MatchParameters match;
+    bool try_filters;
+    Band *bands;
+    int band_count;
+    int next_band;
+    Mutex *lock;
+    Condition *band_done;
+
+} PngJob;
+
+static void build_tables(void)
+{
+    if(tablesReady) return;
+    for(int code = 0; code < 29; code++){
+        for(int length = LENGTH_BASE[code]; length < LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) && length <= MAX_MATCH; length++)
+            lengthCodes[length] = code;
+    }
+    for(int code = 0; code < DISTANCE_CODES; code++){
+        for(int distance = DISTANCE_BASE[code]; distance < DISTANCE_BASE[code] + (1 << DISTANCE_EXTRA[code]); distance++){
+            int index = distance - 1;
+            if(index < 256) distanceCodes[index] = code;
+            else distanceCodes[256 + (index >> 7)] = code;
+        }
+    }
+    for(uint32_t n = 0; n < 256; n++){
+        uint32_t c = n;
+        for(int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+    tablesReady = true;
+}
+
+static int distance_code(int distance)
+{
+    int index = distance - 1;
+    return index < 256 ? distanceCodes[index] : distanceCodes[256 + (index >> 7)];
+}
+
+static uint32_t update_crc(uint32_t crc, const unsigned char *bytes, size_t count)
+{
+    crc = ~crc;
+    for(size_t i = 0; i < count; i++) crc = crcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t update_adler(uint32_t adler, const unsigned char *bytes, size_t count)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while(count > 0){
+        // 5552 bytes is the most that can be added before b could overflow.
+        size_t chunk = count < 5552 ? count : 5552;
+        count -= chunk;
+        while(chunk--){
+            a += *bytes++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return a | (b << 16);
+}
+
+// Returns the adler32 of two sequences joined, from the adler32 of each and the length of the second.
+static uint32_t combine_adler(uint32_t first, uint32_t second, size_t secondLength)
+{
+    uint32_t remainder = secondLength % ADLER_BASE;
+    uint32_t a = first & 0xFFFF;
+    uint32_t b = (remainder * a) % ADLER_BASE;
+    a += (second & 0xFFFF) + ADLER_BASE - 1;
+    b += (first >> 16) + (second >> 16) + ADLER_BASE - remainder;
+    if(a >= ADLER_BASE) a -= ADLER_BASE;
+    if(a >= ADLER_BASE) a -= ADLER_BASE;
+    if(b >= 2 * ADLER_BASE) b -= 2 * ADLER_BASE;
+    if(b >= ADLER_BASE) b -= ADLER_BASE;
+    return a | (b << 16);
+}
+
+// FILTERS
+
+static unsigned char paeth(int left, int above, int corner)
+{
+    int estimate = left + above - corner;
+    int toLeft = abs(estimate - left);
+    int toAbove = abs(estimate - above);
+    int toCorner = abs(estimate - corner);
+    if(toLeft <= toAbove && toLeft <= toCorner) return left;
+    if(toAbove <= toCorner) return above;
+    return corner;
+}
+
+// Returns the value filter type predicts for a byte from the one on its left, above it and above on the left.
+static unsigned char predict(int type, int left, int above, int corner)
+{
+    switch(type)
+    {
+        case 0: return 0;
+        case 1: return left;
+        case 2: return above;
+        case 3: return (left + above) >> 1;
+        default: return paeth(left,above,corner);
+    }
+}
+
+#if defined(__SSE2__)
+static __m128i absolute_epi16(__m128i value)
+{
+    return _mm_max_epi16(value,_mm_sub_epi16(_mm_setzero_si128(),value));
+}
+
+// Paeth predictor of eight 16 bit lanes. The distances of the estimate to left, above and corner are |above - corner|,
+// |left - corner| and |left + above - 2 corner|, so it never has to be computed.
+static __m128i paeth_epi16(__m128i left, __m128i above, __m128i corner)
+{
+    __m128i toLeft = absolute_epi16(_mm_sub_epi16(above,corner));
+    __m128i toAbove = absolute_epi16(_mm_sub_epi16(left,corner));
+    __m128i toCorner = absolute_epi16(_mm_add_epi16(_mm_sub_epi16(above,corner),_mm_sub_epi16(left,corner)));
+    __m128i notLeft = _mm_or_si128(_mm_cmpgt_epi16(toLeft,toAbove),_mm_cmpgt_epi16(toLeft,toCorner));
+    __m128i useCorner = _mm_cmpgt_epi16(toAbove,toCorner);
+    __m128i aboveOrCorner = _mm_or_si128(_mm_and_si128(useCorner,corner),_mm_andnot_si128(useCorner,above));
+    return _mm_or_si128(_mm_and_si128(notLeft,aboveOrCorner),_mm_andnot_si128(notLeft,left));
+}
+#endif
+
+// Writes row, filtered with type, into out. above is the row over it, all zeros for the first row.
+// Every prediction only reads bytes that aren't filtered, so the row is filtered 16 bytes at a time.
+static void filter_row(int type, const unsigned char *row, const unsigned char *above, int count, unsigned char *out)
+{
+    // The first pixel has nothing on its left.
+    for(int i = 0; i < 4; i++) out[i] = row[i] - predict(type,0,above[i],0);
+    int i = 4;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for(; i + 16 <= count; i += 16){
+        __m128i left = _mm_loadu_si128((const __m128i *)(row + i - 4));
+        __m128i up = _mm_loadu_si128((const __m128i *)(above + i));
+        __m128i corner = _mm_loadu_si128((const __m128i *)(above + i - 4));
+        __m128i prediction;
+        switch(type)
+        {
+            case 0: prediction = zero; break;
+            case 1: prediction = left; break;
+            case 2: prediction = up; break;
+            // _mm_avg_epu8 rounds up, the average of PNG rounds down.
+            case 3: prediction = _mm_sub_epi8(_mm_avg_epu8(left,up),_mm_and_si128(_mm_xor_si128(left,up),one)); break;
+            default:
+                prediction = _mm_packus_epi16(
+                    paeth_epi16(_mm_unpacklo_epi8(left,zero),_mm_unpacklo_epi8(up,zero),_mm_unpacklo_epi8(corner,zero)),
+                    paeth_epi16(_mm_unpackhi_epi8(left,zero),_mm_unpackhi_epi8(up,zero),_mm_unpackhi_epi8(corner,zero)));
+                break;
+        }
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(row + i));
+        _mm_storeu_si128((__m128i *)(out + i),_mm_sub_epi8(bytes,prediction));
+    }
+#endif
+    for(; i < count; i++) out[i] = row[i] - predict(type,row[i - 4],above[i],above[i - 4]);
+}
+
+// Returns how far the filtered bytes are from zero, the filter with the smallest sum tends to compress best.
+static unsigned long filter_cost(const unsigned char *filtered, int count)
+{
+    unsigned long cost = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    // min(v, 256 - v) is the distance to zero of v as a signed byte.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for(; i + 16 <= count; i += 16){
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(filtered + i));
+        sum = _mm_add_epi64(sum,_mm_sad_epu8(_mm_min_epu8(bytes,_mm_sub_epi8(zero,bytes)),zero));
+    }
+    cost = (unsigned long)_mm_cvtsi128_si32(sum) + (unsigned long)_mm_cvtsi128_si32(_mm_srli_si128(sum,8));
+#endif
+    for(; i < count; i++) cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+    return cost;
+}
+
+// Writes the filter type and the filtered bytes of row y into out. candidates holds room for 5 rows.
+static void filter_image_row(const PngJob *job, int y, const unsigned char *zeros, unsigned char *candidates, unsigned char *out)
+{
+    int count = job->width * 4;
+    const unsigned char *row = (const unsigned char *)image_row(&job->rows,y);
+    const unsigned char *above = y > 0 ? (const unsigned char *)image_row(&job->rows,y - 1) : zeros;
+
+    if(!job->try_filters){
+        out[0] = 1;
+        filter_row(1,row,above,count,out + 1);
+        return;
+    }
+    int best = 0;
+    unsigned long bestCost = 0;
+    for(int type = 0; type < 5; type++){
+        filter_row(type,row,above,count,candidates + (size_t)type * count);
+        unsigned long cost = filter_cost(candidates + (size_t)type * count,count);
+        if(type == 0 || cost < bestCost){
+            best = type;
+            bestCost = cost;
+        }
+    }
+    out[0] = best;
+    memcpy(out + 1,candidates + (size_t)best * count,count);
+}
+
+// BIT WRITER
+
+static bool reserve_bytes(BitWriter *writer, size_t count)
+{
+    if(writer->size + count + 8 <= writer->capacity) return true;
+    size_t capacity = writer->capacity * 2 + count + 8;
+    unsigned char *data = realloc(writer->data,capacity);
+    if(!data) return false;
+    writer->data = data;
+    writer->capacity = capacity;
+    return true;
+}
+
+// Appends the count low bits of value, least significant first. Room must have been reserved.
+static void put_bits(BitWriter *writer, uint32_t value, int count)
+{
+    writer->bits |= (uint64_t)value << writer->count;
+    writer->count += count;
+    if(writer->count >= 32){
+        for(int i = 0; i < 4; i++) writer->data[writer->size++] = (unsigned char)(writer->bits >> (8 * i));
+        writer->bits >>= 32;
+        writer->count -= 32;
+    }
+}
+
+static void align_bits(BitWriter *writer)
+{
+    while(writer->count > 0){
+        writer->data[writer->size++] = (unsigned char)writer->bits;
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+    writer->bits = 0;
+    writer->count = 0;
+}
+
+// HUFFMAN CODES
+
+typedef struct
+{
+    unsigned int frequency;
+    int symbol;
+
+} Leaf;
+
+static int compare_leaves(const void *a, const void *b)
+{
+    const Leaf *first = a, *second = b;
+    if(first->frequency != second->frequency) return first->frequency < second->frequency ? -1 : 1;
+    return first->symbol - second->symbol;
+}
+
+// Writes into lengths the code lengths, at most limit bits long, of a Huffman code for the count symbols with frequencies.
+// When a code gets too long the frequencies are halved, which flattens the tree, and it's built again.
+static void huffman_lengths(const unsigned int *frequencies, int count, int limit, unsigned char *lengths)
+{
+    Leaf leaves[LITLEN_CODES];
+    unsigned int weights[2 * LITLEN_CODES];
+    int parents[2 * LITLEN_CODES];
+    unsigned char depths[2 * LITLEN_CODES];
+    unsigned int scaled[LITLEN_CODES];
+    memcpy(scaled,frequencies,count * sizeof(unsigned int));
+
+    for(;;){
+        int used = 0;
+        for(int i = 0; i < count; i++){
+            lengths[i] = 0;
+            if(scaled[i] > 0) leaves[used++] = (Leaf){scaled[i],i};
+        }
+        // A code needs two symbols to be complete, unused ones are added with a length of 1.
+        if(used < 2){
+            int first = used == 1 ? leaves[0].symbol : 0;
+            lengths[first] = 1;
+            lengths[first == 0 ? 1 : 0] = 1;
+            return;
+        }
+        qsort(leaves,used,sizeof(Leaf),compare_leaves);
+
+        // Leaves and merged nodes are both taken in order of weight from two queues, nodes are made in order so the second stays sorted.
+        for(int i = 0; i < used; i++) weights[i] = leaves[i].frequency;
+        int nextLeaf = 0, nextNode = used, nodes = used;
+        while(nodes < 2 * used - 1){
+            int pair[2];
+            for(int k = 0; k < 2; k++){
+                if(nextLeaf < used && (nextNode >= nodes || weights[nextLeaf] <= weights[nextNode])) pair[k] = nextLeaf++;
+                else pair[k] = nextNode++;
+            }
+            weights[nodes] = weights[pair[0]] + weights[pair[1]];
+            parents[pair[0]] = parents[pair[1]] = nodes;
+            nodes++;
+        }
+        int longest = 0;
+        depths[nodes - 1] = 0;
+        for(int i = nodes - 2; i >= 0; i--){
+            depths[i] = depths[parents[i]] + 1;
+            if(depths[i] > longest) longest = depths[i];
+        }
+        if(longest <= limit){
+            for(int i = 0; i < used; i++) lengths[leaves[i].symbol] = depths[i];
+            return;
+        }
+        for(int i = 0; i < count; i++) if(scaled[i] > 0) scaled[i] = (scaled[i] >> 1) | 1;
+    }
+}
+
+// Writes into codes the canonical codes for lengths, bit reversed since deflate writes them most significant bit first.
+static void huffman_codes(const unsigned char *lengths, int count, unsigned short *codes)
+{
+    int lengthCount[MAX_CODE_LENGTH + 1] = {0};
+    int nextCode[MAX_CODE_LENGTH + 1] = {0};
+    for(int i = 0; i < count; i++) lengthCount[lengths[i]]++;
+    lengthCount[0] = 0;
+    int code = 0;
+    for(int bits = 1; bits <= MAX_CODE_LENGTH; bits++){
+        code = (code + lengthCount[bits - 1]) << 1;
+        nextCode[bits] = code;
+    }
+    for(int i = 0; i < count; i++){
+        int length = lengths[i];
+        if(length == 0) continue;
+        int value = nextCode[length]++;
+        int reversed = 0;
+        for(int bit = 0; bit < length; bit++) reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+        codes[i] = reversed;
+    }
+}
+
+// DEFLATE
+
+// Writes symbols as a deflate block with Huffman codes of its own.
+static bool write_block(BitWriter *writer, const Symbol *symbols, int count)
+{
+    unsigned int litlenFrequencies[LITLEN_CODES] = {0};
+    unsigned int distanceFrequencies[DISTANCE_CODES] = {0};
+    for(int i = 0; i < count; i++){
+        if(symbols[i].distance == 0) litlenFrequencies[symbols[i].length]++;
+        else{
+            litlenFrequencies[257 + lengthCodes[symbols[i].length]]++;
+            distanceFrequencies[distance_code(symbols[i].distance)]++;
+        }
+    }
+    litlenFrequencies[END_OF_BLOCK] = 1;
+
+    unsigned char lengths[LITLEN_CODES + DISTANCE_CODES];
+    unsigned char *litlenLengths = lengths;
+    unsigned char distanceLengths[DISTANCE_CODES];
+    unsigned short litlenCodes[LITLEN_CODES], distanceCodesOfBlock[DISTANCE_CODES];
+    huffman_lengths(litlenFrequencies,LITLEN_CODES,MAX_CODE_LENGTH,litlenLengths);
+    huffman_lengths(distanceFrequencies,DISTANCE_CODES,MAX_CODE_LENGTH,distanceLengths);
+    huffman_codes(litlenLengths,LITLEN_CODES,litlenCodes);
+    huffman_codes(distanceLengths,DISTANCE_CODES,distanceCodesOfBlock);
+
+    int litlenCount = LITLEN_CODES;
+    while(litlenCount > 257 && litlenLengths[litlenCount - 1] == 0) litlenCount--;
+    int distanceCount = DISTANCE_CODES;
+    while(distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) distanceCount--;
+    memcpy(lengths + litlenCount,distanceLengths,distanceCount);
+    int total = litlenCount + distanceCount;
+
+    // The code lengths are themselves run-length encoded: 16 repeats the last length, 17 and 18 repeat zeros.
+    unsigned char runs[LITLEN_CODES + DISTANCE_CODES];
+    unsigned char runExtras[LITLEN_CODES + DISTANCE_CODES];
+    unsigned int runFrequencies[CODE_LENGTH_CODES] = {0};
+    int runCount = 0;
+    for(int i = 0; i < total;){
+        int length = lengths[i];
+        int repeat = 1;
+        while(i + repeat < total && lengths[i + repeat] == length) repeat++;
+        i += repeat;
+        if(length == 0){
+            while(repeat >= 11){
+                int take = repeat > 138 ? 138 : repeat;
+                runs[runCount] = 18;
+                runExtras[runCount++] = take - 11;
+                repeat -= take;
+            }
+            if(repeat >= 3){
+                runs[runCount] = 17;
+                runExtras[runCount++] = repeat - 3;
+                repeat = 0;
+            }
+        }
+        else{
+            runs[runCount] = length;
+            runExtras[runCount++] = 0;
+            repeat--;
+            while(repeat >= 3){
+                int take = repeat > 6 ? 6 : repeat;
+                runs[runCount] = 16;
+                runExtras[runCount++] = take - 3;
+                repeat -= take;
+            }
+        }
+        while(repeat-- > 0){
+            runs[runCount] = length;
+            runExtras[runCount++] = 0;
+        }
+    }
+    for(int i = 0; i < runCount; i++) runFrequencies[runs[i]]++;
+    unsigned char runLengths[CODE_LENGTH_CODES];
+    unsigned short runCodes[CODE_LENGTH_CODES];
+    huffman_lengths(runFrequencies,CODE_LENGTH_CODES,MAX_CODE_LENGTH_CODE,runLengths);
+    huffman_codes(runLengths,CODE_LENGTH_CODES,runCodes);
+    int runLengthCount = CODE_LENGTH_CODES;
+    while(runLengthCount > 4 && runLengths[CODE_LENGTH_ORDER[runLengthCount - 1]] == 0) runLengthCount--;
+
+    // Worst case every symbol takes a 15 bit length code with 5 extra bits and a 15 bit distance code with 13 extra bits.
+    if(!reserve_bytes(writer,(size_t)count * 6 + 1024)) return false;
+    put_bits(writer,2 << 1,3);
+    put_bits(writer,litlenCount - 257,5);
+    put_bits(writer,distanceCount - 1,5);
+    put_bits(writer,runLengthCount - 4,4);
+    for(int i = 0; i < runLengthCount; i++) put_bits(writer,runLengths[CODE_LENGTH_ORDER[i]],3);
+    for(int i = 0; i < runCount; i++){
+        put_bits(writer,runCodes[runs[i]],runLengths[runs[i]]);
+        if(runs[i] == 16) put_bits(writer,runExtras[i],2);
+        else if(runs[i] == 17) put_bits(writer,runExtras[i],3);
+        else if(runs[i] == 18) put_bits(writer,runExtras[i],7);
+    }
+
+    for(int i = 0; i < count; i++){
+        Symbol symbol = symbols[i];
+        if(symbol.distance == 0){
+            put_bits(writer,litlenCodes[symbol.length],litlenLengths[symbol.length]);
+            continue;
+        }
+        int code = lengthCodes[symbol.length];
+        put_bits(writer,litlenCodes[257 + code],litlenLengths[257 + code]);
+        if(LENGTH_EXTRA[code]) put_bits(writer,symbol.length - LENGTH_BASE[code],LENGTH_EXTRA[code]);
+        code = distance_code(symbol.distance);
+        put_bits(writer,distanceCodesOfBlock[code],distanceLengths[code]);
+        if(DISTANCE_EXTRA[code]) put_bits(writer,symbol.distance - DISTANCE_BASE[code],DISTANCE_EXTRA[code]);
+    }
+    put_bits(writer,litlenCodes[END_OF_BLOCK],litlenLengths[END_OF_BLOCK]);
+    return true;
+}
+
+static inline uint32_t hash_bytes(const unsigned char *bytes)
+{
+    uint32_t value = bytes[0] | (bytes[1] << 8) | ((uint32_t)bytes[2] << 16);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Returns the length of the longest match, of at least MIN_MATCH bytes, for the bytes at position and sets distance to how far back it starts.
+// Returns 0 if there is none. Matches stop at end, where the band ends.
+static int longest_match(const unsigned char *bytes, int position, int end, const int *head, const int *previous, const MatchParameters *match, int *distance)
+{
+    if(position + MIN_MATCH > end) return 0;
+    int limit = end - position < MAX_MATCH ? end - position : MAX_MATCH;
+    int best = MIN_MATCH - 1;
+    int chain = match->chain;
+    const unsigned char *current = bytes + position;
+
+    for(int candidate = head[hash_bytes(current)]; candidate >= 0 && position - candidate <= WINDOW_SIZE && chain-- > 0; candidate = previous[candidate]){
+        const unsigned char *earlier = bytes + candidate;
+        if(earlier[best] != current[best] || earlier[0] != current[0]) continue;
+        int length = 0;
+        while(length + 8 <= limit){
+            uint64_t a, b;
+            memcpy(&a,earlier + length,8);
+            memcpy(&b,current + length,8);
+            if(a != b) break;
+            length += 8;
+        }
+        while(length < limit && earlier[length] == current[length]) length++;
+        if(length > best){
+            best = length;
+            *distance = position - candidate;
+            if(length >= match->nice || length == limit) break;
+        }
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+// Scratch memory of a thread, kept from one band to the next.
+typedef struct
+{
+    unsigned char *filtered;
+    unsigned char *candidates;
+    unsigned char *zeros;
+    int *head;
+    int *previous;
+    Symbol *symbols;
+
+} Scratch;
+
+// Compresses the filtered bytes [start, end) into writer as non-final blocks followed by an empty stored block.
+// The bytes before start are the dictionary, matches can reach back into them.
+static bool deflate_band(BitWriter *writer, const unsigned char *bytes, int start, int end, const MatchParameters *match, Scratch *scratch)
+{
+    int *head = scratch->head;
+    int *previous = scratch->previous;
+    Symbol *symbols = scratch->symbols;
+    int symbolCount = 0;
+
+    for(int i = 0; i < HASH_SIZE; i++) head[i] = -1;
+    #define INSERT(p) do{ if((p) + MIN_MATCH <= end){ uint32_t h = hash_bytes(bytes + (p)); previous[p] = head[h]; head[h] = (p); } }while(0)
+    for(int p = 0; p < start; p++) INSERT(p);
+
+    int position = start;
+    bool haveNext = false;
+    int nextLength = 0, nextDistance = 0;
+    while(position < end){
+        int length, distance = 0;
+        if(haveNext){
+            length = nextLength;
+            distance = nextDistance;
+            haveNext = false;
+        }
+        else length = longest_match(bytes,position,end,head,previous,match,&distance);
+        INSERT(position);
+
+        if(length > 0 && match->lazy && length < match->nice){
+            nextLength = longest_match(bytes,position + 1,end,head,previous,match,&nextDistance);
+            haveNext = true;
+            if(nextLength > length) length = 0;
+        }
+
+        if(length > 0){
+            symbols[symbolCount++] = (Symbol){length,distance};
+            if(length <= match->insert_limit){
+                for(int i = 1; i < length; i++) INSERT(position + i);
+            }
+            position += length;
+            haveNext = false;
+        }
+        else{
+            symbols[symbolCount++] = (Symbol){bytes[position],0};
+            position++;
+        }
+        if(symbolCount == BLOCK_SYMBOLS){
+            if(!write_block(writer,symbols,symbolCount)) return false;
+            symbolCount = 0;
+        }
+    }
+    #undef INSERT
+    if(symbolCount > 0 && !write_block(writer,symbols,symbolCount)) return false;
+
+    // Empty stored block, it ends the band on a byte boundary so the next one can be appended to it.
+    if(!reserve_bytes(writer,16)) return false;
+    put_bits(writer,0,3);
+    align_bits(writer);
+    static const unsigned char storedEnd[4] = {0x00,0x00,0xFF,0xFF};
+    memcpy(writer->data + writer->size,storedEnd,4);
+    writer->size += 4;
+    return true;
+}
+
+// Filters and compresses band into a buffer that starts with room for the length and type of its IDAT chunk.
+static bool encode_band(const PngJob *job, Band *band, Scratch *scratch)
+{
+    int rowBytes = job->width * 4 + 1;
+    int dictionaryRows = (WINDOW_SIZE + rowBytes - 1) / rowBytes;
+    int firstRow = band->first_row - dictionaryRows < 0 ? 0 : band->first_row - dictionaryRows;
+
+    for(int y = firstRow; y < band->last_row; y++)
+        filter_image_row(job,y,scratch->zeros,scratch->candidates,scratch->filtered + (size_t)(y - firstRow) * rowBytes);
+
+    // Only the last WINDOW_SIZE bytes of the rows above can be referenced.
+    int start = (band->first_row - firstRow) * rowBytes;
+    int skip = start > WINDOW_SIZE ? start - WINDOW_SIZE : 0;
+    const unsigned char *bytes = scratch->filtered + skip;
+    int end = (band->last_row - firstRow) * rowBytes - skip;
+    start -= skip;
+
+    band->adler = update_adler(1,bytes + start,end - start);
+
+    BitWriter writer = {0};
+    if(!reserve_bytes(&writer,(size_t)(end - start) / 4 + 64)){
+        free(writer.data);
+        return false;
+    }
+    writer.size = 8;
+    if(!deflate_band(&writer,bytes,start,end,&job->match,scratch)){
+        free(writer.data);
+        return false;
+    }
+    memcpy(writer.data + 4,"IDAT",4);
+    band->crc = update_crc(0,writer.data + 4,writer.size - 4);
+    band->data = writer.data;
+    band->size = writer.size - 8;
+    return true;
+}
+
+static void png_worker(void *arg)
+{
+    PngJob *job = (PngJob *)arg;
+    int rowBytes = job->width * 4 + 1;
+    int bandRows = job->bands[0].last_row - job->bands[0].first_row;
+    int dictionaryRows = (WINDOW_SIZE + rowBytes - 1) / rowBytes;
+    size_t filteredBytes = (size_t)(bandRows + dictionaryRows) * rowBytes;
+
+    Scratch scratch;
+    scratch.filtered = malloc(filteredBytes);
+    scratch.candidates = malloc((size_t)5 * (rowBytes - 1));
+    scratch.zeros = calloc(rowBytes,1);
+    scratch.head = malloc(HASH_SIZE * sizeof(int));
+    scratch.previous = malloc(filteredBytes * sizeof(int));
+    scratch.symbols = malloc(BLOCK_SYMBOLS * sizeof(Symbol));
+    bool ready = scratch.filtered && scratch.candidates && scratch.zeros && scratch.head && scratch.previous && scratch.symbols;
+
+    for(;;){
+        mutex_lock(job->lock);
+        int index = job->next_band++;
+        mutex_unlock(job->lock);
+        if(index >= job->band_count) break;
+
+        Band *band = &job->bands[index];
+        bool encoded = ready && encode_band(job,band,&scratch);
+
+        mutex_lock(job->lock);
+        band->failed = !encoded;
+        band->done = true;
+        condition_broadcast(job->band_done);
+        mutex_unlock(job->lock);
+    }
+
+    free(scratch.filtered);
+    free(scratch.candidates);
+    free(scratch.zeros);
+    free(scratch.head);
+    free(scratch.previous);
+    free(scratch.symbols);
+}
+
+// WRITING
+
+static void put_u32(unsigned char *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool write_chunk(FILE *file, const char *type, const unsigned char *data, uint32_t size)
+{
+    unsigned char header[8], footer[4];
+    put_u32(header,size);
+    memcpy(header + 4,type,4);
+    uint32_t crc = update_crc(update_crc(0,header + 4,4),data,size);
+    put_u32(footer,crc);
+    return fwrite(header,1,8,file) == 8 && (size == 0 || fwrite(data,1,size,file) == size) && fwrite(footer,1,4,file) == 4;
+}
+
+bool write_png(const char *path, const ImageRows *rows, PngLevel level, ProgressFunc progress, void *data)
+{
+    int width = rows->width;
+    int height = rows->height;
+    if(width <= 0 || height <= 0) return false;
+    build_tables();
+
+    FILE *file = fopen(path,"wb");
+    if(!file) return false;
+
+    PngJob job = {0};
+    job.rows = *rows;
+    job.width = width;
+    job.match = LEVELS[level];
+    job.try_filters = level != PNG_FAST;
+
+    int rowBytes = width * 4 + 1;
+    int bandRows = PNG_BAND_BYTES / rowBytes > 0 ? PNG_BAND_BYTES / rowBytes : 1;
+    job.band_count = (height + bandRows - 1) / bandRows;
+    job.bands = calloc(job.band_count,sizeof(Band));
+    if(!job.bands){
+        fclose(file);
+        return false;
+    }
+    for(int i = 0; i < job.band_count; i++){
+        job.bands[i].first_row = i * bandRows;
+        job.bands[i].last_row = (i + 1) * bandRows < height ? (i + 1) * bandRows : height;
+    }
+    job.lock = mutex();
+    job.band_done = condition();
+
+    int threadCount = processor_count();
+    if(threadCount > job.band_count) threadCount = job.band_count;
+    Thread **threads = malloc(threadCount * sizeof(Thread *));
+    int started = 0;
+    for(int i = 0; threads && i < threadCount; i++){
+        threads[i] = thread_start(png_worker,&job);
+        if(threads[i]) started++;
+        else break;
+    }
+    // Without threads the bands are compressed here, one at a time.
+    if(started == 0) png_worker(&job);
+
+    static const unsigned char signature[8] = {0x89,'P','N','G','\r','\n',0x1A,'\n'};
+    unsigned char header[13];
+    put_u32(header,width);
+    put_u32(header + 4,height);
+    header[8] = 8;  // Bits per channel.
+    header[9] = 6;  // RGBA.
+    header[10] = header[11] = header[12] = 0;
+    // zlib header: deflate with a 32 KB window, and how hard it was compressed.
+    static const unsigned char zlibHeaders[3][2] = {{0x78,0x01},{0x78,0x9C},{0x78,0xDA}};
+
+    bool written = fwrite(signature,1,8,file) == 8 && write_chunk(file,"IHDR",header,13) && write_chunk(file,"IDAT",zlibHeaders[level],2);
+    uint32_t adler = 1;
+    for(int i = 0; i < job.band_count; i++){
+        Band *band = &job.bands[i];
+        mutex_lock(job.lock);
+        while(!band->done) condition_wait(job.band_done,job.lock);
+        mutex_unlock(job.lock);
+
+        if(written && !band->failed){
+            unsigned char footer[4];
+            put_u32(band->data,band->size);
+            put_u32(footer,band->crc);
+            written = fwrite(band->data,1,band->size + 8,file) == band->size + 8 && fwrite(footer,1,4,file) == 4;
+            size_t bandBytes = (size_t)(band->last_row - band->first_row) * rowBytes;
+            adler = combine_adler(adler,band->adler,bandBytes);
+        }
+        else written = false;
+        free(band->data);
+        band->data = NULL;
+        if(progress) progress((float)(i + 1) / job.band_count,data);
+    }
+    for(int i = 0; i < started; i++) thread_join(threads[i]);
+    free(threads);
+
+    // Final empty block with the fixed codes, then the adler32 of every filtered byte.
+    unsigned char trailer[6] = {0x03,0x00};
+    put_u32(trailer + 2,adler);
+    written = written && write_chunk(file,"IDAT",trailer,6) && write_chunk(file,"IEND",NULL,0);
+
+    free_condition(job.band_done);
+    free_mutex(job.lock);
+    free(job.bands);
+    if(fclose(file) != 0) written = false;
+    if(!written) remove(path);
+    return written;
+}
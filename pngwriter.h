@@ -0,0 +1,27 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+#include "imagewriter.h"
+
+// PNG writer that compresses the image on every core.
+// The image is split in bands of rows, each band is filtered and deflated by its own thread into a piece of a single
+// zlib stream: the last 32 KB of the band above are used as its dictionary and it ends on a byte boundary with an
+// empty stored block, so the pieces are written one after the other and their checksums combined.
+
+// Trade-off between the time taken to compress a PNG and its size.
+// PNG_FAST filters every row with Sub and barely searches for matches, PNG_SMALL tries every filter and searches the longest.
+typedef enum
+{
+    PNG_FAST = 0,
+    PNG_BALANCED,
+    PNG_SMALL
+} PngLevel;
+
+// Function that writes rows into an 8 bit RGBA PNG file at path and returns true if it was written.
+// The threads read the rows while the file is written, they must not change until it returns.
+// progress, when it isn't NULL, is called by the calling thread every time a band is written.
+bool write_png(const char *path, const ImageRows *rows, PngLevel level, ProgressFunc progress, void *data);
+
+#endif
@@ -0,0 +1,534 @@
+#include "raster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Definition of an Edge of the polygon that crosses the centers of rows [first_row, last_row).
+// x is where it crosses the center of the current row and step how much x moves from one row to the next.
+// direction is 1 if the edge goes down and -1 if it goes up, for the non-zero rule.
+typedef struct s_edge
+{
+    int first_row;
+    int last_row;
+    float x;
+    float step;
+    int direction;
+
+} Edge;
+
+// Edges are kept between calls, so the buffer only grows for polygons with more vertices than any before.
+static Edge *edgeBuffer = NULL;
+static Edge **activeBuffer = NULL;
+static int edgeCapacity = 0;
+
+static bool reserve_edges(int count)
+{
+    if(count <= edgeCapacity) return true;
+    Edge *newEdges = realloc(edgeBuffer, sizeof(Edge) * count);
+    if(!newEdges){
+        fprintf(stderr, "Error: failed to allocate memory for polygon edges.\n");
+        return false;
+    }
+    edgeBuffer = newEdges;
+    Edge **newActive = realloc(activeBuffer, sizeof(Edge *) * count);
+    if(!newActive){
+        fprintf(stderr, "Error: failed to allocate memory for polygon edges.\n");
+        return false;
+    }
+    activeBuffer = newActive;
+    edgeCapacity = count;
+    return true;
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    const Edge *e1 = (const Edge *)a;
+    const Edge *e2 = (const Edge *)b;
+    return (e1->first_row > e2->first_row) - (e1->first_row < e2->first_row);
+}
+
+Color blend_pixel(Color pixel, Color color, int alpha)
+{
+    int inverse = 255 - alpha;
+    return (Color){
+        (unsigned char)((color.r * alpha + pixel.r * inverse + 127) / 255),
+        (unsigned char)((color.g * alpha + pixel.g * inverse + 127) / 255),
+        (unsigned char)((color.b * alpha + pixel.b * inverse + 127) / 255),
+        (unsigned char)((alpha * 255 + pixel.a * inverse + 127) / 255)
+    };
+}
+
+void blend_row(Color *pixels, const unsigned char *coverage, int count, Color color)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    // Four pixels at a time in 16 bit lanes, the color with an alpha of 255 so the alpha channel is blended source-over,
+    // and (v + 1 + (v >> 8)) >> 8 is v / 255 for every v the blend can reach.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(127);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i source = _mm_set_epi16(255,color.b,color.g,color.r,255,color.b,color.g,color.r);
+    for(; x + 4 <= count; x += 4){
+        unsigned int block;
+        memcpy(&block,coverage + x,sizeof(block));
+        if(block == 0) continue;
+        int alpha[4];
+        for(int i = 0; i < 4; i++) alpha[i] = (coverage[x + i] * color.a + 127) / 255;
+        __m128i destination = _mm_loadu_si128((const __m128i *)(pixels + x));
+        __m128i result[2];
+        for(int part = 0; part < 2; part++){
+            int a0 = alpha[part * 2];
+            int a1 = alpha[part * 2 + 1];
+            __m128i a = _mm_set_epi16(a1,a1,a1,a1,a0,a0,a0,a0);
+            __m128i d = part == 0 ? _mm_unpacklo_epi8(destination,zero) : _mm_unpackhi_epi8(destination,zero);
+            __m128i v = _mm_add_epi16(_mm_mullo_epi16(source,a),_mm_mullo_epi16(d,_mm_sub_epi16(full,a)));
+            v = _mm_add_epi16(v,half);
+            v = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v,one),_mm_srli_epi16(v,8)),8);
+            result[part] = v;
+        }
+        _mm_storeu_si128((__m128i *)(pixels + x),_mm_packus_epi16(result[0],result[1]));
+    }
+#endif
+    for(; x < count; x++){
+        if(coverage[x] == 0) continue;
+        pixels[x] = blend_pixel(pixels[x],color,(coverage[x] * color.a + 127) / 255);
+    }
+}
+
+// Fills the pixels whose centers are between x1 and x2 in row and returns false if there are none.
+static bool fill_span(Color *row, int width, float x1, float x2, Color color, int *minX, int *maxX)
+{
+    int first = (int)ceilf(x1 - 0.5f);
+    int last = (int)ceilf(x2 - 0.5f);
+    if(first < 0) first = 0;
+    if(last > width) last = width;
+    if(first >= last) return false;
+
+    if(color.a == 255){
+        for(int x = first; x < last; x++) row[x] = color;
+    }
+    else{
+        for(int x = first; x < last; x++) row[x] = blend_pixel(row[x],color,color.a);
+    }
+    if(first < *minX) *minX = first;
+    if(last > *maxX) *maxX = last;
+    return true;
+}
+
+bool fill_polygon(Color *pixels, int width, int height, int stride, const Vector2 *vertices, int count, FillRule rule, Color color, Rectangle *bounds)
+{
+    if(count < 3 || width <= 0 || height <= 0 || !reserve_edges(count)) return false;
+
+    // Edge table: every edge that crosses the center of at least one row, sorted by the first row it crosses.
+    int edgeCount = 0;
+    for(int i = 0; i < count; i++){
+        Vector2 a = vertices[i];
+        Vector2 b = vertices[(i + 1) % count];
+        int direction = 1;
+        if(a.y > b.y){
+            Vector2 swap = a;
+            a = b;
+            b = swap;
+            direction = -1;
+        }
+        int firstRow = (int)ceilf(a.y - 0.5f);
+        int lastRow = (int)ceilf(b.y - 0.5f);
+        if(firstRow >= lastRow) continue;
+
+        Edge *edge = &edgeBuffer[edgeCount++];
+        edge->step = (b.x - a.x) / (b.y - a.y);
+        edge->first_row = firstRow;
+        edge->last_row = lastRow;
+        edge->x = a.x + (firstRow + 0.5f - a.y) * edge->step;
+        edge->direction = direction;
+    }
+    if(edgeCount == 0) return false;
+    qsort(edgeBuffer, edgeCount, sizeof(Edge), compare_edges);
+
+    int minX = width, maxX = 0, minY = height, maxY = 0;
+    int activeCount = 0;
+    int next = 0;
+    int y = edgeBuffer[0].first_row < 0 ? 0 : edgeBuffer[0].first_row;
+
+    while(y < height && (next < edgeCount || activeCount > 0)){
+        // Edges starting above the canvas are moved to the first visible row.
+        while(next < edgeCount && edgeBuffer[next].first_row <= y){
+            Edge *edge = &edgeBuffer[next++];
+            if(edge->last_row <= y) continue;
+            edge->x += (y - edge->first_row) * edge->step;
+            activeBuffer[activeCount++] = edge;
+        }
+
+        // The active edges are already almost sorted from the previous row, so insertion sort is close to linear.
+        for(int i = 1; i < activeCount; i++){
+            Edge *edge = activeBuffer[i];
+            int j = i - 1;
+            while(j >= 0 && activeBuffer[j]->x > edge->x){
+                activeBuffer[j + 1] = activeBuffer[j];
+                j--;
+            }
+            activeBuffer[j + 1] = edge;
+        }
+
+        Color *row = pixels + (long)y * stride;
+        bool filled = false;
+        if(rule == FILL_EVEN_ODD){
+            for(int i = 0; i + 1 < activeCount; i += 2)
+                filled |= fill_span(row,width,activeBuffer[i]->x,activeBuffer[i + 1]->x,color,&minX,&maxX);
+        }
+        else{
+            int winding = 0;
+            for(int i = 0; i + 1 < activeCount; i++){
+                winding += activeBuffer[i]->direction;
+                if(winding != 0)
+                    filled |= fill_span(row,width,activeBuffer[i]->x,activeBuffer[i + 1]->x,color,&minX,&maxX);
+            }
+        }
+        if(filled){
+            if(y < minY) minY = y;
+            maxY = y + 1;
+        }
+
+        // Edges that end on this row leave the table, the others move to the next row.
+        y++;
+        int kept = 0;
+        for(int i = 0; i < activeCount; i++){
+            Edge *edge = activeBuffer[i];
+            if(edge->last_row <= y) continue;
+            edge->x += edge->step;
+            activeBuffer[kept++] = edge;
+        }
+        activeCount = kept;
+        // Skip the rows above the next edge when nothing is active.
+        if(activeCount == 0 && next < edgeCount && edgeBuffer[next].first_row > y) y = edgeBuffer[next].first_row;
+    }
+
+    if(minY >= maxY) return false;
+    if(bounds) *bounds = (Rectangle){minX,minY,maxX - minX,maxY - minY};
+    return true;
+}
+
+Path *path(void)
+{
+    Path *newPath = malloc(sizeof(Path));
+    if(!newPath){
+        fprintf(stderr, "Error: failed to allocate memory for path.\n");
+        exit(EXIT_FAILURE);
+    }
+    newPath->point_capacity = 64;
+    newPath->points = malloc(sizeof(Vector2) * newPath->point_capacity);
+    newPath->contour_capacity = 8;
+    newPath->contours = malloc(sizeof(int) * newPath->contour_capacity);
+    if(!newPath->points || !newPath->contours){
+        fprintf(stderr, "Error: failed to allocate memory for path.\n");
+        exit(EXIT_FAILURE);
+    }
+    newPath->point_count = 0;
+    newPath->contour_count = 0;
+    newPath->contour_start = 0;
+    return newPath;
+}
+
+void add_path_point(Path *path, Vector2 point)
+{
+    if(path->point_count >= path->point_capacity){
+        Vector2 *newPoints = realloc(path->points, sizeof(Vector2) * path->point_capacity * 2);
+        if(!newPoints){
+            fprintf(stderr, "Error: failed to reallocate memory for path points.\n");
+            return;
+        }
+        path->points = newPoints;
+        path->point_capacity *= 2;
+    }
+    path->points[path->point_count++] = point;
+}
+
+void close_path_contour(Path *path)
+{
+    int count = path->point_count - path->contour_start;
+    if(count == 0) return;
+    if(path->contour_count >= path->contour_capacity){
+        int *newContours = realloc(path->contours, sizeof(int) * path->contour_capacity * 2);
+        if(!newContours){
+            fprintf(stderr, "Error: failed to reallocate memory for path contours.\n");
+            path->point_count = path->contour_start;
+            return;
+        }
+        path->contours = newContours;
+        path->contour_capacity *= 2;
+    }
+    path->contours[path->contour_count++] = count;
+    path->contour_start = path->point_count;
+}
+
+void add_rectangle_contour(Path *path, Rectangle rec, int direction)
+{
+    Vector2 corners[4] = {
+        {rec.x, rec.y},
+        {rec.x + rec.width, rec.y},
+        {rec.x + rec.width, rec.y + rec.height},
+        {rec.x, rec.y + rec.height}
+    };
+    for(int i = 0; i < 4; i++) add_path_point(path,corners[direction > 0 ? i : 3 - i]);
+    close_path_contour(path);
+}
+
+int curve_segments(float radius, float max_error)
+{
+    if(radius <= max_error) return 3;
+    int segments = (int)ceilf(PI / acosf(1.0f - max_error / radius));
+    if(segments < 3) return 3;
+    // Past this the chords are shorter than a pixel for any canvas size.
+    if(segments > 4096) return 4096;
+    return segments;
+}
+
+void add_ellipse_contour(Path *path, Vector2 center, float radiusH, float radiusV, int direction)
+{
+    if(radiusH <= 0 || radiusV <= 0) return;
+    int segments = curve_segments(radiusH > radiusV ? radiusH : radiusV, MAX_CHORD_ERROR);
+
+    // The point on the unit circle is rotated one step at a time instead of calling cosf and sinf for each one.
+    float stepCos = cosf(2 * PI / segments);
+    float stepSin = sinf(2 * PI / segments) * (direction > 0 ? 1 : -1);
+    float c = 1.0f;
+    float s = 0.0f;
+    for(int i = 0; i < segments; i++){
+        add_path_point(path,(Vector2){center.x + c * radiusH, center.y + s * radiusV});
+        float rotated = c * stepCos - s * stepSin;
+        s = s * stepCos + c * stepSin;
+        c = rotated;
+    }
+    close_path_contour(path);
+}
+
+void add_round_segment(Path *path, Vector2 start, Vector2 end, float thickness)
+{
+    float radius = thickness / 2;
+    float dx = end.x - start.x;
+    float dy = end.y - start.y;
+    float length = sqrtf(dx * dx + dy * dy);
+    if(length > 0){
+        // Normal pointing to the right of the segment on screen, so the corners below go clockwise.
+        Vector2 normal = {-dy / length * radius, dx / length * radius};
+        add_path_point(path,(Vector2){start.x - normal.x, start.y - normal.y});
+        add_path_point(path,(Vector2){end.x - normal.x, end.y - normal.y});
+        add_path_point(path,(Vector2){end.x + normal.x, end.y + normal.y});
+        add_path_point(path,(Vector2){start.x + normal.x, start.y + normal.y});
+        close_path_contour(path);
+    }
+    add_ellipse_contour(path,end,radius,radius,1);
+}
+
+void clear_path(Path *path)
+{
+    path->point_count = 0;
+    path->contour_count = 0;
+    path->contour_start = 0;
+}
+
+void free_path(Path *path)
+{
+    free(path->points);
+    free(path->contours);
+    free(path);
+}
+
+// Adds to acc the signed area that the edge from a to b covers in every cell of the rows it crosses, a cell on the
+// right gets the area the edge leaves to its right. Summing a row from the left then gives the coverage of each pixel.
+// The edge must be inside columns [0, width] of acc, which must have at least width + 2 columns.
+static void accumulate_edge(float *acc, int accWidth, int width, int rows, Vector2 a, Vector2 b)
+{
+    if(a.y == b.y) return;
+    float direction = 1.0f;
+    if(a.y > b.y){
+        Vector2 swap = a;
+        a = b;
+        b = swap;
+        direction = -1.0f;
+    }
+    float step = (b.x - a.x) / (b.y - a.y);
+    int firstRow = a.y < 0 ? 0 : (int)a.y;
+    int lastRow = (int)ceilf(b.y);
+    if(lastRow > rows) lastRow = rows;
+    float x = a.x + (firstRow > a.y ? (firstRow - a.y) * step : 0);
+    x = x < 0 ? 0 : x > width ? width : x;
+
+    for(int y = firstRow; y < lastRow; y++){
+        float *row = acc + (size_t)y * accWidth;
+        float top = y > a.y ? y : a.y;
+        float bottom = y + 1 < b.y ? y + 1 : b.y;
+        float height = bottom - top;
+        // Rounding drifts x as it moves down the edge, it's kept in [0, width] so no cell outside the row is touched.
+        float nextX = x + step * height;
+        nextX = nextX < 0 ? 0 : nextX > width ? width : nextX;
+        float d = height * direction;
+        float x0 = x < nextX ? x : nextX;
+        float x1 = x < nextX ? nextX : x;
+        float x0Floor = floorf(x0);
+        int x0i = (int)x0Floor;
+        int x1i = (int)ceilf(x1);
+
+        if(x1i <= x0i + 1){
+            // The edge stays in one cell: the part of it to the right of the edge goes to the next cell.
+            float middle = 0.5f * (x + nextX) - x0Floor;
+            row[x0i] += d - d * middle;
+            row[x0i + 1] += d * middle;
+        }
+        else{
+            // The edge crosses several cells: the first and last get a triangle, the ones in between the same slice.
+            float inverse = 1.0f / (x1 - x0);
+            float x0f = x0 - x0Floor;
+            float firstArea = 0.5f * inverse * (1.0f - x0f) * (1.0f - x0f);
+            float x1f = x1 - x1i + 1.0f;
+            float lastArea = 0.5f * inverse * x1f * x1f;
+            row[x0i] += d * firstArea;
+            if(x1i == x0i + 2){
+                row[x0i + 1] += d * (1.0f - firstArea - lastArea);
+            }
+            else{
+                float secondArea = inverse * (1.5f - x0f);
+                row[x0i + 1] += d * (secondArea - firstArea);
+                for(int xi = x0i + 2; xi < x1i - 1; xi++) row[xi] += d * inverse;
+                float beforeLast = secondArea + (x1i - x0i - 3) * inverse;
+                row[x1i - 1] += d * (1.0f - beforeLast - lastArea);
+            }
+            row[x1i] += d * lastArea;
+        }
+        x = nextX;
+    }
+}
+
+// Splits the edge at the left and right sides of acc and moves the parts outside onto those sides,
+// where they still change the winding of the pixels to their right.
+static void accumulate_clipped_edge(float *acc, int accWidth, int width, int rows, Vector2 a, Vector2 b)
+{
+    float cuts[4] = {0.0f, 1.0f, 1.0f, 1.0f};
+    int cutCount = 1;
+    float sides[2] = {0.0f, (float)width};
+    for(int i = 0; i < 2; i++){
+        if((a.x < sides[i]) != (b.x < sides[i])){
+            float t = (sides[i] - a.x) / (b.x - a.x);
+            if(cutCount == 2 && t < cuts[1]){
+                cuts[2] = cuts[1];
+                cuts[1] = t;
+            }
+            else{
+                cuts[cutCount] = t;
+            }
+            cutCount++;
+        }
+    }
+    cuts[cutCount] = 1.0f;
+
+    for(int i = 0; i < cutCount; i++){
+        Vector2 from = {a.x + (b.x - a.x) * cuts[i], a.y + (b.y - a.y) * cuts[i]};
+        Vector2 to = {a.x + (b.x - a.x) * cuts[i + 1], a.y + (b.y - a.y) * cuts[i + 1]};
+        from.x = from.x < 0 ? 0 : from.x > width ? width : from.x;
+        to.x = to.x < 0 ? 0 : to.x > width ? width : to.x;
+        accumulate_edge(acc,accWidth,width,rows,from,to);
+    }
+}
+
+// Turns the cells of a row into the winding of every pixel by adding them up from the left.
+static void sum_row(float *row, int count)
+{
+#if defined(__SSE2__)
+    __m128 offset = _mm_setzero_ps();
+    for(int i = 0; i < count; i += 4){
+        __m128 x = _mm_loadu_ps(&row[i]);
+        // Prefix sum of the four lanes, then the total of the lanes before them.
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        x = _mm_add_ps(x, offset);
+        _mm_storeu_ps(&row[i], x);
+        offset = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+#else
+    float sum = 0.0f;
+    for(int i = 0; i < count; i++){
+        sum += row[i];
+        row[i] = sum;
+    }
+#endif
+}
+
+bool fill_path(Color *pixels, int width, int height, int stride, const Path *path, FillRule rule, Color color, Rectangle *bounds)
+{
+    if(path->point_count < 3 || color.a == 0) return false;
+
+    float minX = path->points[0].x, maxX = minX;
+    float minY = path->points[0].y, maxY = minY;
+    for(int i = 1; i < path->point_count; i++){
+        Vector2 point = path->points[i];
+        if(point.x < minX) minX = point.x;
+        if(point.x > maxX) maxX = point.x;
+        if(point.y < minY) minY = point.y;
+        if(point.y > maxY) maxY = point.y;
+    }
+    int left = minX < 0 ? 0 : (int)floorf(minX);
+    int top = minY < 0 ? 0 : (int)floorf(minY);
+    int right = maxX >= width ? width : (int)ceilf(maxX);
+    int bottom = maxY >= height ? height : (int)ceilf(maxY);
+    if(left >= right || top >= bottom) return false;
+
+    // Two more cells than pixels for the area right of the last pixel, rounded up to whole groups of four for sum_row().
+    int areaWidth = right - left;
+    int areaHeight = bottom - top;
+    int accWidth = (areaWidth + 2 + 3) & ~3;
+    float *acc = calloc((size_t)accWidth * areaHeight, sizeof(float));
+    if(!acc){
+        fprintf(stderr, "Error: failed to allocate memory to rasterize path.\n");
+        return false;
+    }
+
+    int start = 0;
+    for(int c = 0; c < path->contour_count; c++){
+        int count = path->contours[c];
+        for(int i = 0; i < count; i++){
+            Vector2 a = path->points[start + i];
+            Vector2 b = path->points[start + (i + 1) % count];
+            accumulate_clipped_edge(acc,accWidth,areaWidth,areaHeight,(Vector2){a.x - left, a.y - top},(Vector2){b.x - left, b.y - top});
+        }
+        start += count;
+    }
+
+    int filledLeft = width, filledRight = 0, filledTop = height, filledBottom = 0;
+    for(int y = 0; y < areaHeight; y++){
+        float *cells = acc + (size_t)y * accWidth;
+        sum_row(cells,accWidth);
+        Color *row = pixels + (long)(y + top) * stride + left;
+        bool covered = false;
+        for(int x = 0; x < areaWidth; x++){
+            float coverage = fabsf(cells[x]);
+            if(rule == FILL_EVEN_ODD){
+                coverage = fmodf(coverage,2.0f);
+                if(coverage > 1.0f) coverage = 2.0f - coverage;
+            }
+            else if(coverage > 1.0f){
+                coverage = 1.0f;
+            }
+            int alpha = (int)(coverage * color.a + 0.5f);
+            if(alpha == 0) continue;
+            row[x] = alpha == 255 ? color : blend_pixel(row[x],color,alpha);
+            if(x < filledLeft) filledLeft = x;
+            if(x + 1 > filledRight) filledRight = x + 1;
+            covered = true;
+        }
+        if(covered){
+            if(y < filledTop) filledTop = y;
+            filledBottom = y + 1;
+        }
+    }
+    free(acc);
+
+    if(filledTop >= filledBottom) return false;
+    if(bounds) *bounds = (Rectangle){left + filledLeft, top + filledTop, filledRight - filledLeft, filledBottom - filledTop};
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Rules deciding which regions of a self-intersecting polygon are inside it.
+typedef enum
+{
+    FILL_EVEN_ODD = 0,
+    FILL_NON_ZERO
+
+} FillRule;
+
+// Returns color with opacity alpha (0-255) blended over pixel, like raylib's default blend mode does for the color channels.
+// The alpha channel is blended source-over instead, so opaque pixels stay opaque under anti-aliased edges.
+Color blend_pixel(Color pixel, Color color, int alpha);
+
+// Function that blends color over count pixels with the opacity of color scaled by their coverage (0-255),
+// giving the same pixels as blend_pixel.
+void blend_row(Color *pixels, const unsigned char *coverage, int count, Color color);
+
+// Fills the polygon of count vertices into pixels with color, blending it over them when color isn't opaque.
+// A pixel is filled when its center is inside the polygon. pixels points to the first pixel of the top row and stride is
+// the number of pixels from one row to the next, negative for images stored bottom-up.
+// bounds, when not NULL, gets the region that was filled. Returns false if no pixel was filled.
+bool fill_polygon(Color *pixels, int width, int height, int stride, const Vector2 *vertices, int count, FillRule rule, Color color, Rectangle *bounds);
+
+// Largest distance, in pixels, between a curve and the straight segments it is flattened into.
+#define MAX_CHORD_ERROR 0.125f
+
+// Definition of a Path made of closed contours, contours holds the number of points of each one.
+// Contours that go around in opposite directions cancel each other, which is how holes and rings are made.
+typedef struct s_path
+{
+    Vector2 *points;
+    int point_count;
+    int point_capacity;
+    int *contours;
+    int contour_count;
+    int contour_capacity;
+    int contour_start;
+
+} Path;
+
+// Creates an empty path and returns a pointer to it.
+Path *path(void);
+
+// Function that appends a point to the contour being built.
+void add_path_point(Path *path, Vector2 point);
+
+// Function that closes the contour being built, the next point starts a new one.
+void close_path_contour(Path *path);
+
+// Function that adds rec as a contour, going clockwise on screen when direction is 1 and counterclockwise when it's -1.
+void add_rectangle_contour(Path *path, Rectangle rec, int direction);
+
+// Function that adds an ellipse as a contour, flattened so it's never farther than MAX_CHORD_ERROR from the curve.
+void add_ellipse_contour(Path *path, Vector2 center, float radiusH, float radiusV, int direction);
+
+// Function that adds a thick segment from start to end with round ends, as two contours going the same way.
+void add_round_segment(Path *path, Vector2 start, Vector2 end, float thickness);
+
+// Returns the number of segments a curve of radius needs so its chords are never farther than max_error from it.
+int curve_segments(float radius, float max_error);
+
+// Function that erases every contour of the path, keeping its memory.
+void clear_path(Path *path);
+
+// Function that frees the memory of the path.
+void free_path(Path *path);
+
+// Fills path into pixels with anti-aliased edges: the area of every pixel covered by the path is computed exactly,
+// by accumulating the signed area under each edge and adding it up along the rows, and becomes the opacity of color there.
+// The cost is fixed for every pixel of the bounding box, whatever the number of edges. pixels, stride and bounds
+// work like in fill_polygon(). Returns false if no pixel was covered.
+bool fill_path(Color *pixels, int width, int height, int stride, const Path *path, FillRule rule, Color color, Rectangle *bounds);
+
+#endif
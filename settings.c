@@ -0,0 +1,128 @@
+#include "settings.h"
+#include "doublylinkedlist.h"
+#include "autosave.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_SETTING_LINE 256
+
+Settings *settings(void)
+{
+    Settings *settings = malloc(sizeof(Settings));
+    if(!settings){
+        fprintf(stderr, "Error: failed to allocate memory for settings.\n");
+        exit(EXIT_FAILURE);
+    }
+    settings->history_budget = DEFAULT_HISTORY_BUDGET;
+    settings->autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
+    return settings;
+}
+
+static bool parse_positive_number(const char *value, long *number)
+{
+    char *end;
+    *number = strtol(value, &end, 10);
+    return end != value && *end == '\0' && *number > 0;
+}
+
+bool apply_setting(Settings *settings, const char *key, const char *value)
+{
+    long number;
+
+    if(strcmp(key, "history_mb") == 0){
+        if(!parse_positive_number(value, &number)){
+            fprintf(stderr, "Warning: history_mb must be a positive number of megabytes, got \"%s\".\n", value);
+            return false;
+        }
+        settings->history_budget = (size_t)number * 1024 * 1024;
+        return true;
+    }
+
+    if(strcmp(key, "autosave_seconds") == 0){
+        if(strcmp(value, "0") != 0 && !parse_positive_number(value, &number)){
+            fprintf(stderr, "Warning: autosave_seconds must be a number of seconds, 0 to disable autosave, got \"%s\".\n", value);
+            return false;
+        }
+        settings->autosave_interval = strcmp(value, "0") == 0 ? 0 : (int)number;
+        return true;
+    }
+
+    fprintf(stderr, "Warning: unknown setting \"%s\".\n", key);
+    return false;
+}
+
+// Removes the spaces at the start and the end of str, returns the new start.
+static char *trim(char *str)
+{
+    while(isspace((unsigned char)*str)) str++;
+    char *end = str + strlen(str);
+    while(end > str && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return str;
+}
+
+bool load_settings_file(Settings *settings, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) return false;
+
+    char line[MAX_SETTING_LINE];
+    while(fgets(line, sizeof(line), file)){
+        char *key = trim(line);
+        if(*key == '\0' || *key == '#') continue;
+
+        char *separator = strchr(key, '=');
+        if(!separator){
+            fprintf(stderr, "Warning: ignoring line \"%s\" in %s.\n", key, path);
+            continue;
+        }
+        *separator = '\0';
+        apply_setting(settings, trim(key), trim(separator + 1));
+    }
+    fclose(file);
+    return true;
+}
+
+void parse_settings_args(Settings *settings, int argc, char **argv)
+{
+    char key[MAX_SETTING_LINE];
+
+    for(int i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--", 2) != 0){
+            fprintf(stderr, "Warning: ignoring argument \"%s\".\n", argv[i]);
+            continue;
+        }
+
+        snprintf(key, sizeof(key), "%s", argv[i] + 2);
+        char *value = strchr(key, '=');
+        if(value){
+            *value++ = '\0';
+        }
+        else if(i + 1 < argc){
+            value = argv[++i];
+        }
+        else{
+            fprintf(stderr, "Warning: missing value for \"%s\".\n", argv[i]);
+            continue;
+        }
+
+        for(char *c = key; *c; c++){
+            if(*c == '-') *c = '_';
+        }
+
+        if(strcmp(key, "config") == 0){
+            if(!load_settings_file(settings, value))
+                fprintf(stderr, "Warning: couldn't open settings file \"%s\".\n", value);
+        }
+        else{
+            apply_setting(settings, key, value);
+        }
+    }
+}
+
+void free_settings(Settings *settings)
+{
+    free(settings);
+}
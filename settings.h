@@ -0,0 +1,34 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Name of the file, next to the executable, that settings are read from at startup.
+#define SETTINGS_FILE_NAME "c-paint.cfg"
+
+// Definition of the options that can be set at startup, from the settings file or the command line.
+typedef struct s_settings
+{
+    size_t history_budget;
+    int autosave_interval;  // Seconds between two autosaves, 0 to disable autosave.
+
+} Settings;
+
+// Creates the settings with their default values and returns a pointer to them.
+Settings *settings(void);
+
+// Function that sets one option from its key and value, e.g. "history_mb" and "256". Returns false if the key or value is invalid.
+bool apply_setting(Settings *settings, const char *key, const char *value);
+
+// Function that reads "key = value" lines from the file at path, lines starting with # are ignored. Returns false if the file can't be opened.
+bool load_settings_file(Settings *settings, const char *path);
+
+// Function that reads options given as "--key value" or "--key=value", dashes in keys are read as underscores.
+// "--config path" loads a settings file at that point of the arguments.
+void parse_settings_args(Settings *settings, int argc, char **argv);
+
+// Function that frees the memory of the settings.
+void free_settings(Settings *settings);
+
+#endif
@@ -0,0 +1,184 @@
+#include "shadow.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Adds rec, clipped to width by height, to region.
+static void add_rectangle(Rectangle *region, Rectangle rec, int width, int height)
+{
+    float left = rec.x < 0 ? 0 : rec.x;
+    float top = rec.y < 0 ? 0 : rec.y;
+    float right = rec.x + rec.width > width ? width : rec.x + rec.width;
+    float bottom = rec.y + rec.height > height ? height : rec.y + rec.height;
+    if(right <= left || bottom <= top) return;
+
+    if(region->width > 0){
+        if(region->x < left) left = region->x;
+        if(region->y < top) top = region->y;
+        if(region->x + region->width > right) right = region->x + region->width;
+        if(region->y + region->height > bottom) bottom = region->y + region->height;
+    }
+    *region = (Rectangle){left,top,right - left,bottom - top};
+}
+
+// Adds the whole canvas to the damage, for drawings that didn't report their region.
+static void damage_all(CanvasShadow *shadow)
+{
+    if(!shadow->reported){
+        shadow->damage = (Rectangle){0,0,shadow->target->texture.width,shadow->target->texture.height};
+    }
+    shadow->reported = false;
+}
+
+static void read_back(CanvasShadow *shadow)
+{
+    UnloadImage(shadow->image);
+    shadow->image = LoadImageFromTexture(shadow->target->texture);
+    ImageFormat(&shadow->image,PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    shadow->stale = false;
+    shadow->dirty = (Rectangle){0};
+}
+
+CanvasShadow *canvas_shadow(RenderTexture2D *target)
+{
+    CanvasShadow *shadow = malloc(sizeof(CanvasShadow));
+    if(!shadow){
+        fprintf(stderr, "Error: failed to allocate memory for canvas shadow.\n");
+        exit(EXIT_FAILURE);
+    }
+    shadow->target = target;
+    shadow->image = (Image){0};
+    shadow->damage = (Rectangle){0};
+    shadow->reported = false;
+    shadow->unsaved = (Rectangle){0};
+    read_back(shadow);
+    return shadow;
+}
+
+void begin_canvas_mode(CanvasShadow *shadow)
+{
+    upload_shadow(shadow);
+    BeginTextureMode(*shadow->target);
+}
+
+void end_canvas_mode(CanvasShadow *shadow)
+{
+    EndTextureMode();
+    shadow->stale = true;
+    damage_all(shadow);
+}
+
+void mark_canvas_drawn(CanvasShadow *shadow)
+{
+    shadow->stale = true;
+    damage_all(shadow);
+}
+
+void damage_canvas(CanvasShadow *shadow, Rectangle rec)
+{
+    add_rectangle(&shadow->damage,rec,shadow->target->texture.width,shadow->target->texture.height);
+    shadow->reported = true;
+}
+
+Rectangle take_canvas_damage(CanvasShadow *shadow)
+{
+    Rectangle damage = shadow->damage;
+    shadow->damage = (Rectangle){0};
+    add_rectangle(&shadow->unsaved,damage,shadow->target->texture.width,shadow->target->texture.height);
+    return damage;
+}
+
+Rectangle take_unsaved_damage(CanvasShadow *shadow)
+{
+    Rectangle unsaved = shadow->unsaved;
+    shadow->unsaved = (Rectangle){0};
+    return unsaved;
+}
+
+void add_unsaved_damage(CanvasShadow *shadow, Rectangle rec)
+{
+    add_rectangle(&shadow->unsaved,rec,shadow->target->texture.width,shadow->target->texture.height);
+}
+
+Color *sync_shadow(CanvasShadow *shadow)
+{
+    bool resized = shadow->image.width != shadow->target->texture.width || shadow->image.height != shadow->target->texture.height;
+    if(shadow->stale || resized){
+        // Changes made for a canvas of another size are lost with it.
+        if(!resized) upload_shadow(shadow);
+        read_back(shadow);
+    }
+    return (Color *)shadow->image.data;
+}
+
+Color *get_shadow_row(CanvasShadow *shadow, int y)
+{
+    return (Color *)shadow->image.data + (size_t)(shadow->image.height - 1 - y) * shadow->image.width;
+}
+
+Color get_shadow_color(CanvasShadow *shadow, int x, int y)
+{
+    sync_shadow(shadow);
+    if(x < 0 || y < 0 || x >= shadow->image.width || y >= shadow->image.height) return BLANK;
+    return get_shadow_row(shadow,y)[x];
+}
+
+void mark_shadow_changed(CanvasShadow *shadow, Rectangle rec)
+{
+    add_rectangle(&shadow->dirty,rec,shadow->image.width,shadow->image.height);
+    add_rectangle(&shadow->damage,rec,shadow->image.width,shadow->image.height);
+}
+
+void upload_shadow(CanvasShadow *shadow)
+{
+    Rectangle dirty = shadow->dirty;
+    if(dirty.width <= 0 || dirty.height <= 0) return;
+    shadow->dirty = (Rectangle){0};
+
+    int x = (int)dirty.x;
+    int width = (int)dirty.width;
+    int height = (int)dirty.height;
+    // Rows are bottom-up, so the region starts at the row of its bottom edge.
+    int textureY = shadow->image.height - (int)dirty.y - height;
+    Color *pixels = (Color *)shadow->image.data + (size_t)textureY * shadow->image.width;
+
+    if(width == shadow->image.width){
+        UpdateTextureRec(shadow->target->texture,(Rectangle){0,textureY,width,height},pixels);
+        return;
+    }
+
+    Color *packed = malloc(sizeof(Color) * width * height);
+    if(!packed){
+        fprintf(stderr, "Error: failed to allocate memory to upload the canvas.\n");
+        UpdateTexture(shadow->target->texture,shadow->image.data);
+        return;
+    }
+    for(int row = 0; row < height; row++){
+        memcpy(&packed[row * width],&pixels[(size_t)row * shadow->image.width + x],width * sizeof(Color));
+    }
+    UpdateTextureRec(shadow->target->texture,(Rectangle){x,textureY,width,height},packed);
+    free(packed);
+}
+
+void load_shadow_pixels(CanvasShadow *shadow, const Color *pixels, int width, int height)
+{
+    if(shadow->target->texture.width != width || shadow->target->texture.height != height){
+        UnloadRenderTexture(*shadow->target);
+        *shadow->target = LoadRenderTexture(width,height);
+    }
+    if(shadow->image.width != width || shadow->image.height != height){
+        UnloadImage(shadow->image);
+        shadow->image = GenImageColor(width,height,BLANK);
+    }
+    memcpy(shadow->image.data,pixels,(size_t)width * height * sizeof(Color));
+    UpdateTexture(shadow->target->texture,shadow->image.data);
+    shadow->stale = false;
+    shadow->dirty = (Rectangle){0};
+    shadow->damage = (Rectangle){0,0,width,height};
+}
+
+void free_shadow(CanvasShadow *shadow)
+{
+    UnloadImage(shadow->image);
+    free(shadow);
+}
@@ -0,0 +1,76 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Definition of a CanvasShadow, a copy of the canvas kept in system memory so its pixels can be read and changed
+// without a GPU readback each time. image has the rows bottom-up, like the render texture.
+// stale is set when the canvas was drawn on the GPU since the copy was last read back,
+// dirty is the region, in canvas coordinates, changed on the CPU and not uploaded yet.
+// damage is the region changed by the tools since it was last taken, on the CPU or the GPU, which the history
+// compares instead of the whole canvas. reported is set once a GPU drawing reported its region.
+// unsaved gathers the damage taken by the history since the autosave last took it.
+typedef struct s_canvasshadow
+{
+    RenderTexture2D *target;
+    Image image;
+    bool stale;
+    Rectangle dirty;
+    Rectangle damage;
+    bool reported;
+    Rectangle unsaved;
+
+} CanvasShadow;
+
+// Creates the shadow of the canvas target and returns a pointer to it. target must stay valid, it may be reloaded with another size.
+CanvasShadow *canvas_shadow(RenderTexture2D *target);
+
+// Function that uploads the pending changes and starts drawing into the canvas on the GPU.
+void begin_canvas_mode(CanvasShadow *shadow);
+
+// Function that ends drawing into the canvas, the copy will be read back the next time it's needed.
+// Unless the drawing reported its region with damage_canvas() the whole canvas is taken as damaged.
+void end_canvas_mode(CanvasShadow *shadow);
+
+// Function that marks the canvas as drawn on the GPU outside begin_canvas_mode() and end_canvas_mode(),
+// damaging the whole canvas unless the drawing reported its region.
+void mark_canvas_drawn(CanvasShadow *shadow);
+
+// Function that adds rec, in canvas coordinates, to the damage of a drawing on the GPU. It must cover every pixel
+// the drawing may change, and be called before the drawing ends.
+void damage_canvas(CanvasShadow *shadow, Rectangle rec);
+
+// Returns the region damaged since the last call and clears it.
+Rectangle take_canvas_damage(CanvasShadow *shadow);
+
+// Returns the region damaged, and taken with take_canvas_damage(), since the last call and clears it.
+Rectangle take_unsaved_damage(CanvasShadow *shadow);
+
+// Function that adds rec, in canvas coordinates, to the region not autosaved yet, for the pixels the history
+// swaps on undo and redo, which aren't damage the history has to compare.
+void add_unsaved_damage(CanvasShadow *shadow, Rectangle rec);
+
+// Function that reads the canvas back if it was drawn on the GPU or resized, and returns the pixels of the copy.
+Color *sync_shadow(CanvasShadow *shadow);
+
+// Returns the pointer to the first pixel of row y, top-down, of the copy. The copy must be in sync.
+Color *get_shadow_row(CanvasShadow *shadow, int y);
+
+// Returns the color of the canvas at (x, y), reading the canvas back first only if needed.
+Color get_shadow_color(CanvasShadow *shadow, int x, int y);
+
+// Function that adds rec, in canvas coordinates, to the region changed on the CPU and to the damage.
+void mark_shadow_changed(CanvasShadow *shadow, Rectangle rec);
+
+// Function that uploads the region changed on the CPU to the canvas.
+void upload_shadow(CanvasShadow *shadow);
+
+// Function that replaces the whole canvas with width by height pixels, rows bottom-up, reloading it first if its size differs.
+// Unlike a drawing, the copy gets the pixels too. The whole canvas is damaged.
+void load_shadow_pixels(CanvasShadow *shadow, const Color *pixels, int width, int height);
+
+// Function that frees the memory of the shadow.
+void free_shadow(CanvasShadow *shadow);
+
+#endif
@@ -0,0 +1,784 @@
+#include "strokebuffer.h"
+#include "raster.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Pixels the extent of the coverage grows by past the box that made it grow, plus half its size,
+// so a stroke moving on doesn't reallocate it for every dab.
+#define EXTENT_MARGIN 64
+
+// Dab centers and radii are rounded to an eighth of a pixel, so a mask for each of the 8 by 8 positions within
+// a pixel covers every dab of a radius.
+#define MASK_PHASES 8
+
+// Dabs in a row a radius needs before its masks are cached, fewer don't make up for building them.
+#define MASK_REPEATS 64
+
+// Largest radius whose masks are cached, bigger dabs cost about as much drawn directly as copied from a mask.
+#define MAX_MASK_RADIUS 128
+
+// Definition of a DabMask that caches the coverage of round dabs of radius, one mask per subpixel position of the center,
+// built the first time a dab is stamped there. Masks are side by side pixels, the center of the dab being
+// phase / MASK_PHASES pixels right and down of the corner of pixel (reach, reach). last is the radius of the last dab
+// and repeats how many dabs in a row had it, a brush whose size keeps changing draws its dabs directly.
+struct s_dabmask
+{
+    float radius;
+    float last;
+    int repeats;
+    int reach;
+    int side;
+    unsigned char *masks[MASK_PHASES * MASK_PHASES];
+};
+
+// Definition of a SplatKernel that caches a Gaussian falloff of radius, weights scaled so the center is 65535.
+// span holds the coverage added to one row while it's splatted.
+// The standard deviation is a third of the radius, so the falloff is under 2% at the edge where it's cut off.
+struct s_splatkernel
+{
+    float radius;
+    int reach;
+    int side;
+    unsigned short *weights;
+    unsigned char *span;
+};
+
+// Thresholds that spread the fractions of coverage left by a splat over 4 by 4 pixels, instead of dropping them.
+static const unsigned short DITHER[4][4] = {
+    {    0, 32768,  8192, 40960},
+    {49152, 16384, 57344, 24576},
+    {12288, 45056,  4096, 36864},
+    {61440, 28672, 53248, 20480}
+};
+
+StrokeBuffer *stroke_buffer(void)
+{
+    StrokeBuffer *buffer = malloc(sizeof(StrokeBuffer));
+    if(!buffer){
+        fprintf(stderr, "Error: failed to allocate memory for stroke buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    buffer->coverage = NULL;
+    buffer->capacity = 0;
+    buffer->extent = (Rectangle){0};
+    buffer->width = 0;
+    buffer->height = 0;
+    buffer->color = BLANK;
+    buffer->active = false;
+    buffer->dirty = (Rectangle){0};
+    buffer->changed = (Rectangle){0};
+    buffer->predicted = (Rectangle){0};
+    buffer->mask = NULL;
+    buffer->splat = NULL;
+    return buffer;
+}
+
+void begin_stroke_buffer(StrokeBuffer *buffer, int width, int height, Color color)
+{
+    buffer->width = width;
+    buffer->height = height;
+    buffer->extent = (Rectangle){0};
+    buffer->color = color;
+    buffer->active = true;
+    buffer->dirty = (Rectangle){0};
+    buffer->changed = (Rectangle){0};
+    buffer->predicted = (Rectangle){0};
+}
+
+static void add_region(Rectangle *region, int left, int top, int right, int bottom)
+{
+    if(region->width > 0){
+        if(region->x < left) left = region->x;
+        if(region->y < top) top = region->y;
+        if(region->x + region->width > right) right = region->x + region->width;
+        if(region->y + region->height > bottom) bottom = region->y + region->height;
+    }
+    *region = (Rectangle){left,top,right - left,bottom - top};
+}
+
+// Returns the coverage of pixel (x, y), which must be inside the extent.
+static unsigned char *coverage_at(const StrokeBuffer *buffer, int x, int y)
+{
+    return buffer->coverage + (size_t)(y - (int)buffer->extent.y) * (int)buffer->extent.width + (x - (int)buffer->extent.x);
+}
+
+// Copies the coverage of count pixels of row y from x into span, pixels outside the extent have none.
+static void read_coverage(const StrokeBuffer *buffer, int x, int y, int count, unsigned char *span)
+{
+    memset(span,0,count);
+    int left = x > buffer->extent.x ? x : (int)buffer->extent.x;
+    int right = x + count < buffer->extent.x + buffer->extent.width ? x + count : (int)(buffer->extent.x + buffer->extent.width);
+    if(y < buffer->extent.y || y >= buffer->extent.y + buffer->extent.height || left >= right) return;
+    memcpy(span + left - x,coverage_at(buffer,left,y),right - left);
+}
+
+// Grows the extent of the coverage to hold box, which is inside the canvas, keeping the coverage it held.
+static void grow_extent(StrokeBuffer *buffer, const int box[4])
+{
+    int left = buffer->extent.x;
+    int top = buffer->extent.y;
+    int right = left + (int)buffer->extent.width;
+    int bottom = top + (int)buffer->extent.height;
+    bool empty = buffer->extent.width <= 0;
+    if(!empty && box[0] >= left && box[1] >= top && box[2] <= right && box[3] <= bottom) return;
+
+    int marginX = EXTENT_MARGIN + (empty ? 0 : (right - left) / 2);
+    int marginY = EXTENT_MARGIN + (empty ? 0 : (bottom - top) / 2);
+    int newLeft = empty || box[0] < left ? box[0] - marginX : left;
+    int newTop = empty || box[1] < top ? box[1] - marginY : top;
+    int newRight = empty || box[2] > right ? box[2] + marginX : right;
+    int newBottom = empty || box[3] > bottom ? box[3] + marginY : bottom;
+    if(newLeft < 0) newLeft = 0;
+    if(newTop < 0) newTop = 0;
+    if(newRight > buffer->width) newRight = buffer->width;
+    if(newBottom > buffer->height) newBottom = buffer->height;
+
+    int newWidth = newRight - newLeft;
+    size_t bytes = (size_t)newWidth * (newBottom - newTop);
+    unsigned char *coverage;
+    if(empty && bytes <= buffer->capacity){
+        coverage = buffer->coverage;
+        memset(coverage,0,bytes);
+    }
+    else{
+        coverage = calloc(bytes,1);
+        if(!coverage){
+            fprintf(stderr, "Error: failed to allocate memory for stroke coverage.\n");
+            exit(EXIT_FAILURE);
+        }
+        for(int y = top; !empty && y < bottom; y++)
+            memcpy(coverage + (size_t)(y - newTop) * newWidth + (left - newLeft),coverage_at(buffer,left,y),right - left);
+        free(buffer->coverage);
+        buffer->capacity = bytes;
+    }
+    buffer->coverage = coverage;
+    buffer->extent = (Rectangle){newLeft,newTop,newWidth,newBottom - newTop};
+}
+
+// Clips the box to the canvas, grows the extent to hold it and adds it to the dirty and changed regions.
+// Returns false if nothing is left of it.
+static bool clip_box(StrokeBuffer *buffer, float minX, float minY, float maxX, float maxY, int box[4])
+{
+    box[0] = minX < 0 ? 0 : (int)floorf(minX);
+    box[1] = minY < 0 ? 0 : (int)floorf(minY);
+    box[2] = maxX >= buffer->width ? buffer->width : (int)ceilf(maxX);
+    box[3] = maxY >= buffer->height ? buffer->height : (int)ceilf(maxY);
+    if(box[0] >= box[2] || box[1] >= box[3]) return false;
+    grow_extent(buffer,box);
+    add_region(&buffer->dirty,box[0],box[1],box[2],box[3]);
+    add_region(&buffer->changed,box[0],box[1],box[2],box[3]);
+    return true;
+}
+
+// Returns the coverage of a pixel whose center is distance away from the edge of a shape of radius.
+static unsigned char edge_coverage(float radius, float distance)
+{
+    float coverage = radius + 0.5f - distance;
+    if(coverage <= 0.0f) return 0;
+    if(coverage >= 1.0f) return 255;
+    return (unsigned char)(coverage * 255.0f + 0.5f);
+}
+
+// Returns opacity (0-1) as 0-255.
+static int opacity_byte(float opacity)
+{
+    if(opacity <= 0.0f) return 0;
+    if(opacity >= 1.0f) return 255;
+    return (int)(opacity * 255.0f + 0.5f);
+}
+
+// Keeps the highest of the coverage of row and value for count pixels.
+static void max_fill(unsigned char *row, int count, int value)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    // Keeping the highest twice changes nothing, so the last 16 or 4 pixels can overlap the ones before.
+    const __m128i fill = _mm_set1_epi8((char)value);
+    if(count >= 16){
+        for(; x + 16 < count; x += 16){
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + x));
+            _mm_storeu_si128((__m128i *)(row + x),_mm_max_epu8(a,fill));
+        }
+        __m128i a = _mm_loadu_si128((const __m128i *)(row + count - 16));
+        _mm_storeu_si128((__m128i *)(row + count - 16),_mm_max_epu8(a,fill));
+        return;
+    }
+    if(count >= 4){
+        for(int at = 0; at < count; at += 4){
+            int packed;
+            if(at + 4 > count) at = count - 4;
+            memcpy(&packed,row + at,4);
+            packed = _mm_cvtsi128_si32(_mm_max_epu8(_mm_cvtsi32_si128(packed),fill));
+            memcpy(row + at,&packed,4);
+        }
+        return;
+    }
+#endif
+    for(; x < count; x++) if(row[x] < value) row[x] = value;
+}
+
+// Keeps the highest of the coverage of row, which starts at pixel start, and that of the dab of radius centered at center,
+// scaled by opacity (0-255), for the pixels from first to last of the row whose center is dy below the dab's.
+static void max_dab_pixels(unsigned char *row, int start, int first, int last, Vector2 center, float radius, float dy, int opacity)
+{
+    for(int x = first; x < last; x++){
+        float dx = x + 0.5f - center.x;
+        int coverage = edge_coverage(radius,sqrtf(dx * dx + dy * dy)) * opacity + 128;
+        coverage = (coverage + (coverage >> 8)) >> 8;
+        if(coverage > row[x - start]) row[x - start] = coverage;
+    }
+}
+
+#if defined(__SSE2__)
+// Returns the coverage of the dab, the same as max_dab_pixels(), of the pixels whose centers are dx from the dab's
+// in the low four bytes. edge is radius + 0.5 and scale the opacity in every lane.
+static inline int dab_coverage4(__m128 dx, __m128 edge, __m128 dySquared, __m128i scale)
+{
+    __m128 coverage = _mm_sub_ps(edge,_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx,dx),dySquared)));
+    coverage = _mm_min_ps(_mm_max_ps(coverage,_mm_setzero_ps()),_mm_set1_ps(1.0f));
+    __m128i bytes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(coverage,_mm_set1_ps(255.0f)),_mm_set1_ps(0.5f)));
+    __m128i scaled = _mm_add_epi16(_mm_mullo_epi16(_mm_packs_epi32(bytes,bytes),scale),_mm_set1_epi16(128));
+    scaled = _mm_srli_epi16(_mm_add_epi16(scaled,_mm_srli_epi16(scaled,8)),8);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(scaled,scaled));
+}
+
+// Keeps the highest of count bytes of row and those of coverage, lowest first.
+static inline void max_bytes(unsigned char *row, int coverage, int count)
+{
+    int packed = 0;
+    memcpy(&packed,row,count);
+    packed = _mm_cvtsi128_si32(_mm_max_epu8(_mm_cvtsi32_si128(packed),_mm_cvtsi32_si128(coverage)));
+    memcpy(row,&packed,count);
+}
+#endif
+
+// Function that does max_dab_pixels() for both edges of the dab on a row holding pixels start to end,
+// the pixels from edges[0] to edges[1] and from edges[2] to edges[3].
+static void max_dab_edges(unsigned char *row, int start, int end, const int edges[4], Vector2 center, float radius, float dy, int opacity)
+{
+#if defined(__SSE2__)
+    const __m128 edge = _mm_set1_ps(radius + 0.5f);
+    const __m128 dySquared = _mm_set1_ps(dy * dy);
+    const __m128i scale = _mm_set1_epi16(opacity);
+    // Most rows have at most two pixels on each edge, which share one set of four.
+    if(edges[1] - edges[0] <= 2 && edges[3] - edges[2] <= 2){
+        float left = edges[0] + 0.5f - center.x;
+        float right = edges[2] + 0.5f - center.x;
+        int coverage = dab_coverage4(_mm_set_ps(right + 1.0f,right,left + 1.0f,left),edge,dySquared,scale);
+        max_bytes(row + edges[0] - start,coverage,edges[1] - edges[0]);
+        max_bytes(row + edges[2] - start,coverage >> 16,edges[3] - edges[2]);
+        return;
+    }
+    // Otherwise four pixels at a time. Pixels past an edge get the coverage they have anyway,
+    // so the last four of an edge can go past it, or back from the end of the row.
+    if(end - start >= 4){
+        for(int e = 0; e < 4; e += 2){
+            for(int x = edges[e]; x < edges[e + 1]; x += 4){
+                int at = x + 4 > end ? end - 4 : x;
+                __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_set1_ps((float)at + 0.5f),_mm_set_ps(3,2,1,0)),_mm_set1_ps(center.x));
+                max_bytes(row + at - start,dab_coverage4(dx,edge,dySquared,scale),4);
+            }
+        }
+        return;
+    }
+#endif
+    max_dab_pixels(row,start,edges[0],edges[1],center,radius,dy,opacity);
+    max_dab_pixels(row,start,edges[2],edges[3],center,radius,dy,opacity);
+}
+
+// Keeps the highest of the coverage of pixels and that of the dab of radius centered at center, scaled by opacity (0-255),
+// within box. pixels holds the first pixel of the box and rows are stride bytes apart.
+static void max_dab_rows(unsigned char *pixels, int stride, const int box[4], Vector2 center, float radius, int opacity)
+{
+    // Pixels whose center is within radius - 0.5 of the dab's are covered and those past radius + 0.5 aren't,
+    // only the ones in between have their coverage computed. A pixel rounded to the wrong side of either distance
+    // gets the same coverage as it would on the other.
+    float outer = radius + 0.5f;
+    float inner = radius - 0.5f;
+    for(int y = box[1]; y < box[3]; y++){
+        float dy = y + 0.5f - center.y;
+        if(fabsf(dy) >= outer) continue;
+        float half = sqrtf(outer * outer - dy * dy);
+        int first = (int)ceilf(center.x - 0.5f - half);
+        int last = (int)floorf(center.x - 0.5f + half) + 1;
+        int fullFirst = last;
+        int fullLast = last;
+        if(fabsf(dy) < inner){
+            float core = sqrtf(inner * inner - dy * dy);
+            fullFirst = (int)ceilf(center.x - 0.5f - core);
+            fullLast = (int)floorf(center.x - 0.5f + core) + 1;
+        }
+        first = first < box[0] ? box[0] : first;
+        last = last > box[2] ? box[2] : last;
+        if(first >= last) continue;
+        fullFirst = fullFirst < first ? first : fullFirst > last ? last : fullFirst;
+        fullLast = fullLast < fullFirst ? fullFirst : fullLast > last ? last : fullLast;
+
+        unsigned char *row = pixels + (size_t)(y - box[1]) * stride;
+        const int edges[4] = {first,fullFirst,fullLast,last};
+        max_dab_edges(row,box[0],box[2],edges,center,radius,dy,opacity);
+        max_fill(row + fullFirst - box[0],fullLast - fullFirst,opacity);
+    }
+}
+
+static void clear_dab_masks(DabMask *cache)
+{
+    for(int i = 0; i < MASK_PHASES * MASK_PHASES; i++){
+        free(cache->masks[i]);
+        cache->masks[i] = NULL;
+    }
+}
+
+static void free_dab_masks(DabMask *cache)
+{
+    if(!cache) return;
+    clear_dab_masks(cache);
+    free(cache);
+}
+
+// Returns the mask of a dab of radius, already rounded, centered phaseX and phaseY eighths of a pixel from a pixel corner,
+// or NULL if the dab is to be drawn directly.
+static const unsigned char *get_dab_mask(StrokeBuffer *buffer, float radius, int phaseX, int phaseY)
+{
+    DabMask *cache = buffer->mask;
+    if(!cache){
+        cache = calloc(1,sizeof(DabMask));
+        if(!cache){
+            fprintf(stderr, "Error: failed to allocate memory for dab masks.\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->mask = cache;
+    }
+    cache->repeats = cache->last == radius ? cache->repeats + 1 : 1;
+    cache->last = radius;
+    if(cache->side == 0 || cache->radius != radius){
+        if(cache->repeats < MASK_REPEATS || radius > MAX_MASK_RADIUS) return NULL;
+        clear_dab_masks(cache);
+        cache->radius = radius;
+        cache->reach = (int)ceilf(radius) + 1;
+        cache->side = cache->reach * 2 + 1;
+    }
+
+    unsigned char **pixels = &cache->masks[phaseY * MASK_PHASES + phaseX];
+    if(!*pixels){
+        *pixels = calloc((size_t)cache->side * cache->side,1);
+        if(!*pixels){
+            fprintf(stderr, "Error: failed to allocate memory for dab masks.\n");
+            exit(EXIT_FAILURE);
+        }
+        const int box[4] = {0,0,cache->side,cache->side};
+        Vector2 center = {cache->reach + (float)phaseX / MASK_PHASES,cache->reach + (float)phaseY / MASK_PHASES};
+        max_dab_rows(*pixels,cache->side,box,center,radius,255);
+    }
+    return *pixels;
+}
+
+// Keeps the highest of the coverage of row and span, scaled by opacity (0-255), for count pixels.
+static void max_span(unsigned char *row, const unsigned char *span, int count, int opacity)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    if(opacity == 255){
+        for(; x + 16 <= count; x += 16){
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(span + x));
+            _mm_storeu_si128((__m128i *)(row + x),_mm_max_epu8(a,b));
+        }
+    }
+    else{
+        // v * opacity / 255 rounded, as (v + 128 + ((v + 128) >> 8)) >> 8 with v the product.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i scale = _mm_set1_epi16(opacity);
+        const __m128i half = _mm_set1_epi16(128);
+        for(; x + 16 <= count; x += 16){
+            __m128i b = _mm_loadu_si128((const __m128i *)(span + x));
+            __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b,zero),scale),half);
+            __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b,zero),scale),half);
+            low = _mm_srli_epi16(_mm_add_epi16(low,_mm_srli_epi16(low,8)),8);
+            high = _mm_srli_epi16(_mm_add_epi16(high,_mm_srli_epi16(high,8)),8);
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + x));
+            _mm_storeu_si128((__m128i *)(row + x),_mm_max_epu8(a,_mm_packus_epi16(low,high)));
+        }
+    }
+#endif
+    for(; x < count; x++){
+        int v = span[x] * opacity + 128;
+        v = (v + (v >> 8)) >> 8;
+        if(v > row[x]) row[x] = v;
+    }
+}
+
+void stamp_round_dab(StrokeBuffer *buffer, Vector2 center, float radius, float opacity)
+{
+    int alpha = opacity_byte(opacity);
+    if(!buffer->active || alpha == 0) return;
+    int cornerX = (int)floorf(center.x * MASK_PHASES + 0.5f);
+    int cornerY = (int)floorf(center.y * MASK_PHASES + 0.5f);
+    int phaseX = cornerX & (MASK_PHASES - 1);
+    int phaseY = cornerY & (MASK_PHASES - 1);
+    radius = floorf(radius * MASK_PHASES + 0.5f) / MASK_PHASES;
+    // Canvas position of the first pixel of the mask, or of the box the dab is drawn in.
+    int reach = (int)ceilf(radius) + 1;
+    int side = reach * 2 + 1;
+    int left = (cornerX - phaseX) / MASK_PHASES - reach;
+    int top = (cornerY - phaseY) / MASK_PHASES - reach;
+    int box[4];
+    if(!clip_box(buffer,left,top,left + side,top + side,box)) return;
+
+    const unsigned char *pixels = get_dab_mask(buffer,radius,phaseX,phaseY);
+    if(!pixels){
+        Vector2 rounded = {(float)cornerX / MASK_PHASES,(float)cornerY / MASK_PHASES};
+        max_dab_rows(coverage_at(buffer,box[0],box[1]),buffer->extent.width,box,rounded,radius,alpha);
+        return;
+    }
+    for(int y = box[1]; y < box[3]; y++)
+        max_span(coverage_at(buffer,box[0],y),pixels + (size_t)(y - top) * side + box[0] - left,box[2] - box[0],alpha);
+}
+
+void stamp_square_dab(StrokeBuffer *buffer, Vector2 corner, float size, float opacity)
+{
+    int alpha = opacity_byte(opacity);
+    // Same pixels DrawRectangle() covers, which takes the corner and size as whole pixels.
+    int left = (int)corner.x;
+    int top = (int)corner.y;
+    int box[4];
+    if(!buffer->active || alpha == 0 || !clip_box(buffer,left,top,left + (int)size,top + (int)size,box)) return;
+
+    for(int y = box[1]; y < box[3]; y++) max_fill(coverage_at(buffer,box[0],y),box[2] - box[0],alpha);
+}
+
+// Narrows [t0, t1] to the t where a * t <= b.
+static void clip_sweep(float a, float b, float *t0, float *t1)
+{
+    if(a > 0.0f){
+        if(b / a < *t1) *t1 = b / a;
+    }
+    else if(a < 0.0f){
+        if(b / a > *t0) *t0 = b / a;
+    }
+    else if(b < 0.0f){
+        *t1 = -1.0f;
+    }
+}
+
+void stamp_square_sweep(StrokeBuffer *buffer, Vector2 startCorner, Vector2 endCorner, float startSize, float endSize, float opacity)
+{
+    int alpha = opacity_byte(opacity);
+    // The square at t (0-1) has its center at center + t * move and half its side is half + t * grow,
+    // rounded to whole pixels at both ends like stamp_square_dab().
+    float startHalf = (int)startSize / 2.0f;
+    float endHalf = (int)endSize / 2.0f;
+    Vector2 center = {(int)startCorner.x + startHalf,(int)startCorner.y + startHalf};
+    Vector2 move = {(int)endCorner.x + endHalf - center.x,(int)endCorner.y + endHalf - center.y};
+    float half = startHalf;
+    float grow = endHalf - startHalf;
+
+    float minX = fminf(center.x - half,center.x + move.x - half - grow);
+    float minY = fminf(center.y - half,center.y + move.y - half - grow);
+    float maxX = fmaxf(center.x + half,center.x + move.x + half + grow);
+    float maxY = fmaxf(center.y + half,center.y + move.y + half + grow);
+    int box[4];
+    if(!buffer->active || alpha == 0 || !clip_box(buffer,minX,minY,maxX,maxY,box)) return;
+
+    for(int y = box[1]; y < box[3]; y++){
+        // The squares that reach the center of the row are those with |py - centerY(t)| <= half(t), an interval of t
+        // since both sides are linear. Their left and right edges are linear too, so the row is covered between the
+        // edges of the squares at both ends of the interval.
+        float py = y + 0.5f;
+        float t0 = 0.0f, t1 = 1.0f;
+        clip_sweep(-move.y - grow,half - py + center.y,&t0,&t1);
+        clip_sweep(move.y - grow,half + py - center.y,&t0,&t1);
+        if(t0 > t1) continue;
+
+        float left = fminf(center.x + t0 * move.x - half - t0 * grow,center.x + t1 * move.x - half - t1 * grow);
+        float right = fmaxf(center.x + t0 * move.x + half + t0 * grow,center.x + t1 * move.x + half + t1 * grow);
+        // Pixels whose center is inside.
+        int first = (int)ceilf(left - 0.5f);
+        int last = (int)floorf(right - 0.5f);
+        if(first < box[0]) first = box[0];
+        if(last >= box[2]) last = box[2] - 1;
+        if(first > last) continue;
+
+        unsigned char *row = coverage_at(buffer,first,y);
+        if(alpha == 255) memset(row,255,last - first + 1);
+        else for(int x = 0; x <= last - first; x++) if(row[x] < alpha) row[x] = alpha;
+    }
+}
+
+// Returns the coverage of pixel x, y by the capsule around the segment from start to end, its radius going
+// from startRadius to endRadius. The radius is taken at the closest point of the segment, which is exact
+// for an even capsule and close enough for the small changes between two points of a stroke.
+static unsigned char capsule_coverage(Vector2 start, Vector2 end, float startRadius, float endRadius, int x, int y)
+{
+    float segmentX = end.x - start.x;
+    float segmentY = end.y - start.y;
+    float lengthSquared = segmentX * segmentX + segmentY * segmentY;
+    float dx = x + 0.5f - start.x;
+    float dy = y + 0.5f - start.y;
+    // Distance to the closest point of the segment.
+    float t = lengthSquared > 0 ? (dx * segmentX + dy * segmentY) / lengthSquared : 0;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    float ex = dx - t * segmentX;
+    float ey = dy - t * segmentY;
+    return edge_coverage(startRadius + t * (endRadius - startRadius),sqrtf(ex * ex + ey * ey));
+}
+
+static void free_splat_kernel(SplatKernel *kernel)
+{
+    if(!kernel) return;
+    free(kernel->weights);
+    free(kernel->span);
+    free(kernel);
+}
+
+static const SplatKernel *get_splat_kernel(StrokeBuffer *buffer, float radius)
+{
+    SplatKernel *kernel = buffer->splat;
+    if(kernel && kernel->radius == radius) return kernel;
+
+    free_splat_kernel(kernel);
+    buffer->splat = NULL;
+    kernel = malloc(sizeof(SplatKernel));
+    int reach = (int)ceilf(radius);
+    int side = reach * 2 + 1;
+    unsigned short *weights = kernel ? malloc(sizeof(unsigned short) * side * side) : NULL;
+    unsigned char *span = weights ? malloc(side) : NULL;
+    if(!span){
+        fprintf(stderr, "Error: failed to allocate memory for splat kernel.\n");
+        exit(EXIT_FAILURE);
+    }
+    float sigma = radius / 3.0f;
+    for(int y = 0; y < side; y++){
+        for(int x = 0; x < side; x++){
+            float dx = x - reach;
+            float dy = y - reach;
+            float distanceSquared = dx * dx + dy * dy;
+            weights[y * side + x] = distanceSquared > radius * radius ? 0
+                                  : (unsigned short)(65535.0f * expf(-distanceSquared / (2.0f * sigma * sigma)) + 0.5f);
+        }
+    }
+    kernel->radius = radius;
+    kernel->reach = reach;
+    kernel->side = side;
+    kernel->weights = weights;
+    kernel->span = span;
+    buffer->splat = kernel;
+    return kernel;
+}
+
+// Adds span to the coverage of row for count pixels, saturating at 255.
+static void add_span(unsigned char *row, const unsigned char *span, int count)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    for(; x + 16 <= count; x += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(span + x));
+        _mm_storeu_si128((__m128i *)(row + x),_mm_adds_epu8(a,b));
+    }
+#endif
+    for(; x < count; x++){
+        int sum = row[x] + span[x];
+        row[x] = sum > 255 ? 255 : sum;
+    }
+}
+
+void splat_gaussian(StrokeBuffer *buffer, Vector2 center, float radius, float peak, int frame)
+{
+    if(!buffer->active || peak <= 0.0f || radius < 0.5f) return;
+    const SplatKernel *kernel = get_splat_kernel(buffer,radius);
+    int left = (int)floorf(center.x) - kernel->reach;
+    int top = (int)floorf(center.y) - kernel->reach;
+    int box[4];
+    if(!clip_box(buffer,left,top,left + kernel->side,top + kernel->side,box)) return;
+
+    // Coverage added at the center in 16.16 fixed point, more than 255 only saturates sooner.
+    unsigned int scale = peak >= 255.0f ? 255u << 16 : (unsigned int)(peak * 65536.0f);
+    unsigned char *span = kernel->span;
+    for(int y = box[1]; y < box[3]; y++){
+        const unsigned short *weights = kernel->weights + (size_t)(y - top) * kernel->side;
+        // The dither pattern moves every frame so the fractions build up evenly over the splat.
+        const unsigned short *dither = DITHER[(y + frame) & 3];
+        for(int x = box[0]; x < box[2]; x++){
+            unsigned long long amount = (unsigned long long)weights[x - left] * scale;
+            span[x - box[0]] = (unsigned char)(((amount >> 16) + dither[(x + frame * 3) & 3]) >> 16);
+        }
+        add_span(coverage_at(buffer,box[0],y),span,box[2] - box[0]);
+    }
+}
+
+void stamp_capsule(StrokeBuffer *buffer, Vector2 start, Vector2 end, float startRadius, float endRadius, float opacity)
+{
+    int alpha = opacity_byte(opacity);
+    float radius = startRadius > endRadius ? startRadius : endRadius;
+    int box[4];
+    float minX = (start.x < end.x ? start.x : end.x) - radius - 1;
+    float minY = (start.y < end.y ? start.y : end.y) - radius - 1;
+    float maxX = (start.x > end.x ? start.x : end.x) + radius + 1;
+    float maxY = (start.y > end.y ? start.y : end.y) + radius + 1;
+    if(!buffer->active || alpha == 0 || !clip_box(buffer,minX,minY,maxX,maxY,box)) return;
+
+    for(int y = box[1]; y < box[3]; y++){
+        unsigned char *row = coverage_at(buffer,box[0],y);
+        for(int x = box[0]; x < box[2]; x++){
+            int coverage = capsule_coverage(start,end,startRadius,endRadius,x,y) * alpha + 128;
+            coverage = (coverage + (coverage >> 8)) >> 8;
+            if(coverage > row[x - box[0]]) row[x - box[0]] = coverage;
+        }
+    }
+}
+
+// Uploads region of the stroke into preview, or clears it there when clear is true.
+static void upload_region(StrokeBuffer *buffer, RenderTexture2D *preview, Rectangle region, bool clear)
+{
+    int left = region.x;
+    int top = region.y;
+    int width = region.width;
+    int height = region.height;
+    if(width <= 0 || height <= 0) return;
+
+    Color *staging = calloc((size_t)width * height, sizeof(Color));
+    unsigned char *coverage = malloc(width);
+    if(!staging || !coverage){
+        fprintf(stderr, "Error: failed to allocate memory to upload the stroke.\n");
+        free(staging);
+        free(coverage);
+        return;
+    }
+    if(!clear){
+        Color color = buffer->color;
+        for(int row = 0; row < height; row++){
+            // The texture stores rows bottom-up, so the last row of the region goes first.
+            read_coverage(buffer,left,top + height - 1 - row,width,coverage);
+            Color *pixels = staging + (size_t)row * width;
+            for(int x = 0; x < width; x++){
+                if(coverage[x] == 0) continue;
+                pixels[x] = color;
+                pixels[x].a = (unsigned char)((coverage[x] * color.a + 127) / 255);
+            }
+        }
+    }
+    UpdateTextureRec(preview->texture,(Rectangle){left,buffer->height - top - height,width,height},staging);
+    free(staging);
+    free(coverage);
+}
+
+void update_stroke_preview(StrokeBuffer *buffer, RenderTexture2D *preview)
+{
+    if(!buffer->active) return;
+    upload_region(buffer,preview,buffer->changed,false);
+    buffer->changed = (Rectangle){0};
+}
+
+void preview_stroke_prediction(StrokeBuffer *buffer, RenderTexture2D *preview, Vector2 start, Vector2 end, float radius)
+{
+    float dx = end.x - start.x;
+    float dy = end.y - start.y;
+    if(!buffer->active || preview->texture.width != buffer->width || preview->texture.height != buffer->height
+       || dx * dx + dy * dy < 0.25f){
+        clear_stroke_prediction(buffer,preview);
+        return;
+    }
+
+    // The prediction isn't stamped into the coverage, it's uploaded together with the stroke under it,
+    // so the pixels it covered last frame are restored by the same upload.
+    float minX = (start.x < end.x ? start.x : end.x) - radius - 1;
+    float minY = (start.y < end.y ? start.y : end.y) - radius - 1;
+    float maxX = (start.x > end.x ? start.x : end.x) + radius + 1;
+    float maxY = (start.y > end.y ? start.y : end.y) + radius + 1;
+    int box[4];
+    box[0] = minX < 0 ? 0 : (int)floorf(minX);
+    box[1] = minY < 0 ? 0 : (int)floorf(minY);
+    box[2] = maxX >= buffer->width ? buffer->width : (int)ceilf(maxX);
+    box[3] = maxY >= buffer->height ? buffer->height : (int)ceilf(maxY);
+    if(box[0] >= box[2] || box[1] >= box[3]){
+        clear_stroke_prediction(buffer,preview);
+        return;
+    }
+    Rectangle region = buffer->predicted;
+    add_region(&region,box[0],box[1],box[2],box[3]);
+    buffer->predicted = (Rectangle){box[0],box[1],box[2] - box[0],box[3] - box[1]};
+
+    int left = region.x;
+    int top = region.y;
+    int width = region.width;
+    int height = region.height;
+    Color *staging = calloc((size_t)width * height, sizeof(Color));
+    unsigned char *coverage = malloc(width);
+    if(!staging || !coverage){
+        fprintf(stderr, "Error: failed to allocate memory to upload the stroke.\n");
+        free(staging);
+        free(coverage);
+        return;
+    }
+    Color color = buffer->color;
+    for(int row = 0; row < height; row++){
+        int y = top + height - 1 - row;
+        read_coverage(buffer,left,y,width,coverage);
+        Color *pixels = staging + (size_t)row * width;
+        for(int x = left; x < left + width; x++){
+            unsigned char alpha = coverage[x - left];
+            if(x >= box[0] && x < box[2] && y >= box[1] && y < box[3]){
+                unsigned char predicted = capsule_coverage(start,end,radius,radius,x,y);
+                if(predicted > alpha) alpha = predicted;
+            }
+            if(alpha == 0) continue;
+            pixels[x - left] = color;
+            pixels[x - left].a = (unsigned char)((alpha * color.a + 127) / 255);
+        }
+    }
+    UpdateTextureRec(preview->texture,(Rectangle){left,buffer->height - top - height,width,height},staging);
+    free(staging);
+    free(coverage);
+}
+
+void clear_stroke_prediction(StrokeBuffer *buffer, RenderTexture2D *preview)
+{
+    if(preview->texture.width == buffer->width && preview->texture.height == buffer->height)
+        upload_region(buffer,preview,buffer->predicted,!buffer->active);
+    buffer->predicted = (Rectangle){0};
+}
+
+void composite_stroke(StrokeBuffer *buffer, CanvasShadow *canvas, RenderTexture2D *preview)
+{
+    if(!buffer->active) return;
+    buffer->active = false;
+    Rectangle dirty = buffer->dirty;
+    if(dirty.width <= 0 || dirty.height <= 0) return;
+
+    sync_shadow(canvas);
+    // The canvas may have been resized in the middle of the stroke.
+    bool sameSize = canvas->image.width == buffer->width && canvas->image.height == buffer->height;
+    Color color = buffer->color;
+    for(int y = dirty.y; y < dirty.y + dirty.height; y++){
+        unsigned char *coverage = coverage_at(buffer,dirty.x,y);
+        if(sameSize) blend_row(get_shadow_row(canvas,y) + (int)dirty.x,coverage,dirty.width,color);
+        memset(coverage,0,dirty.width);
+    }
+    if(sameSize){
+        mark_shadow_changed(canvas,dirty);
+        upload_shadow(canvas);
+    }
+    if(preview && preview->texture.width == buffer->width && preview->texture.height == buffer->height){
+        add_region(&dirty,buffer->predicted.x,buffer->predicted.y,buffer->predicted.x + buffer->predicted.width,
+                   buffer->predicted.y + buffer->predicted.height);
+        upload_region(buffer,preview,dirty,true);
+    }
+    buffer->dirty = (Rectangle){0};
+    buffer->changed = (Rectangle){0};
+    buffer->predicted = (Rectangle){0};
+}
+
+void free_stroke_buffer(StrokeBuffer *buffer)
+{
+    free_dab_masks(buffer->mask);
+    free_splat_kernel(buffer->splat);
+    free(buffer->coverage);
+    free(buffer);
+}
@@ -0,0 +1,82 @@
+#ifndef STROKEBUFFER_H
+#define STROKEBUFFER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "include/raylib.h"
+#include "shadow.h"
+
+// Coverage of round dabs cached for the radius of a brush that keeps its size.
+typedef struct s_dabmask DabMask;
+
+// Gaussian falloff cached for the radius last splatted.
+typedef struct s_splatkernel SplatKernel;
+
+// Definition of a StrokeBuffer that keeps the coverage (0-255) of the stroke being drawn on a canvas of width by height.
+// Dabs keep the highest coverage instead of adding up, so a stroke never overdraws itself, and the color is blended
+// into the canvas once when the stroke ends. Until then the stroke is shown through the preview texture.
+// coverage only holds extent, rows of extent.width bytes, which grows with the stroke so its cost doesn't depend on
+// the size of the canvas. capacity is the bytes allocated for it, kept from one stroke to the next.
+// dirty is the region touched by the stroke and changed the region touched since the preview was last updated,
+// both in canvas coordinates. Pixels outside dirty are always 0. predicted is the region of the preview showing
+// where the stroke is heading, which is never part of the coverage.
+typedef struct s_strokebuffer
+{
+    unsigned char *coverage;
+    size_t capacity;
+    Rectangle extent;
+    int width;
+    int height;
+    Color color;
+    bool active;
+    Rectangle dirty;
+    Rectangle changed;
+    Rectangle predicted;
+    DabMask *mask;
+    SplatKernel *splat;
+
+} StrokeBuffer;
+
+// Creates an empty stroke buffer and returns a pointer to it.
+StrokeBuffer *stroke_buffer(void);
+
+// Function that starts a stroke of color on a canvas of width by height pixels.
+void begin_stroke_buffer(StrokeBuffer *buffer, int width, int height, Color color);
+
+// Function that stamps a round dab of radius centered at center, with a one pixel anti-aliased edge, its coverage
+// scaled by opacity (0-1). The center and radius are rounded to an eighth of a pixel.
+void stamp_round_dab(StrokeBuffer *buffer, Vector2 center, float radius, float opacity);
+
+// Function that stamps a square dab of size pixels with its top-left corner at corner, with coverage opacity (0-1).
+void stamp_square_dab(StrokeBuffer *buffer, Vector2 corner, float size, float opacity);
+
+// Function that stamps every pixel the square dab covers while it moves from startCorner to endCorner, its size going
+// from startSize to endSize, with coverage opacity (0-1). Corners and sizes are taken as whole pixels like stamp_square_dab().
+void stamp_square_sweep(StrokeBuffer *buffer, Vector2 startCorner, Vector2 endCorner, float startSize, float endSize, float opacity);
+
+// Function that stamps every pixel within the radius, going from startRadius to endRadius, of the segment
+// from start to end, the swept round dab, with its coverage scaled by opacity (0-1).
+void stamp_capsule(StrokeBuffer *buffer, Vector2 start, Vector2 end, float startRadius, float endRadius, float opacity);
+
+// Function that adds to the coverage a Gaussian falloff cut off at radius around center, peak (0-255) at its center.
+// Unlike dabs the coverage adds up, so a spray gets denser the longer it stays. Fractions of coverage are dithered
+// with a pattern that moves with frame, the count of splats so far.
+void splat_gaussian(StrokeBuffer *buffer, Vector2 center, float radius, float peak, int frame);
+
+// Function that uploads the region changed since the last call into preview, the stroke's color with the coverage as alpha.
+void update_stroke_preview(StrokeBuffer *buffer, RenderTexture2D *preview);
+
+// Function that shows in preview, and only there, a capsule of radius from start to end ahead of the stroke,
+// replacing the one shown before.
+void preview_stroke_prediction(StrokeBuffer *buffer, RenderTexture2D *preview, Vector2 start, Vector2 end, float radius);
+
+// Function that removes the prediction from preview.
+void clear_stroke_prediction(StrokeBuffer *buffer, RenderTexture2D *preview);
+
+// Function that blends the stroke into canvas, clears it from preview when it isn't NULL, and ends the stroke.
+void composite_stroke(StrokeBuffer *buffer, CanvasShadow *canvas, RenderTexture2D *preview);
+
+// Function that frees the memory of the stroke buffer.
+void free_stroke_buffer(StrokeBuffer *buffer);
+
+#endif
@@ -0,0 +1,88 @@
+#include "strokefilter.h"
+#include <math.h>
+
+// Smoothing factor of a low-pass filter with cutoff frequency, in Hz, for samples elapsed seconds apart.
+static float smoothing_factor(float cutoff, float elapsed)
+{
+    float tau = 1.0f / (2.0f * PI * cutoff);
+    return 1.0f / (1.0f + tau / elapsed);
+}
+
+static Vector2 one_euro(StrokeFilter *filter, Vector2 point, double time)
+{
+    float elapsed = (float)(time - filter->time);
+    // Samples can share a timestamp, a millisecond is the shortest the input thread waits between them.
+    if(elapsed <= 0.0f) elapsed = 0.001f;
+
+    Vector2 speed = {(point.x - filter->point.x) / elapsed, (point.y - filter->point.y) / elapsed};
+    float a = smoothing_factor(filter->derivative_cutoff,elapsed);
+    filter->velocity.x += a * (speed.x - filter->velocity.x);
+    filter->velocity.y += a * (speed.y - filter->velocity.y);
+
+    // The faster the stroke the higher the cutoff, so fast strokes don't lag and slow ones don't jitter.
+    float magnitude = sqrtf(filter->velocity.x * filter->velocity.x + filter->velocity.y * filter->velocity.y);
+    a = smoothing_factor(filter->min_cutoff + filter->beta * magnitude,elapsed);
+    filter->value.x += a * (point.x - filter->value.x);
+    filter->value.y += a * (point.y - filter->value.y);
+    return filter->value;
+}
+
+static Vector2 raw(StrokeFilter *filter, Vector2 point, double time)
+{
+    float elapsed = (float)(time - filter->time);
+    if(elapsed > 0.0f){
+        filter->velocity = (Vector2){(point.x - filter->point.x) / elapsed, (point.y - filter->point.y) / elapsed};
+    }
+    filter->value = point;
+    return point;
+}
+
+void one_euro_stroke_filter(StrokeFilter *filter)
+{
+    filter->filter = one_euro;
+    filter->min_cutoff = 1.0f;
+    filter->beta = 0.05f;
+    filter->derivative_cutoff = 1.0f;
+    begin_stroke_filter(filter);
+}
+
+void raw_stroke_filter(StrokeFilter *filter)
+{
+    filter->filter = raw;
+    begin_stroke_filter(filter);
+}
+
+void begin_stroke_filter(StrokeFilter *filter)
+{
+    filter->velocity = (Vector2){0,0};
+    filter->started = false;
+}
+
+Vector2 filter_stroke_point(StrokeFilter *filter, Vector2 point, double time)
+{
+    if(!filter->started){
+        filter->value = point;
+        filter->point = point;
+        filter->velocity = (Vector2){0,0};
+        filter->time = time;
+        filter->started = true;
+        return point;
+    }
+    Vector2 filtered = filter->filter(filter,point,time);
+    filter->point = point;
+    filter->time = time;
+    return filtered;
+}
+
+Vector2 end_stroke_filter(StrokeFilter *filter)
+{
+    filter->value = filter->point;
+    return filter->point;
+}
+
+Vector2 predict_stroke_point(StrokeFilter *filter, float time)
+{
+    if(time > MAX_PREDICTION_TIME) time = MAX_PREDICTION_TIME;
+    if(time < 0.0f) time = 0.0f;
+    return (Vector2){filter->value.x + filter->velocity.x * time, filter->value.y + filter->velocity.y * time};
+}
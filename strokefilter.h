@@ -0,0 +1,50 @@
+#ifndef STROKEFILTER_H
+#define STROKEFILTER_H
+
+#include <stdbool.h>
+#include "include/raylib.h"
+
+// Longest time ahead, in seconds, the live preview of a stroke is predicted.
+#define MAX_PREDICTION_TIME 0.05f
+
+typedef struct s_strokefilter StrokeFilter;
+
+// Function that returns the filtered position of the stroke for a point read at time, in seconds.
+typedef Vector2 (*FilterFunc)(StrokeFilter *filter, Vector2 point, double time);
+
+// Definition of a StrokeFilter that sits between the mouse samples and the brush, smoothing the path of a stroke.
+// point and time are the last point read, value and velocity the filtered position and speed, in pixels per second.
+// min_cutoff, beta and derivative_cutoff are the parameters of the One-Euro filter: the lower min_cutoff the smoother
+// slow strokes are, the higher beta the less fast strokes lag behind.
+struct s_strokefilter
+{
+    FilterFunc filter;
+    float min_cutoff;
+    float beta;
+    float derivative_cutoff;
+    Vector2 point;
+    Vector2 value;
+    Vector2 velocity;
+    double time;
+    bool started;
+};
+
+// Function that sets filter to smooth strokes with the One-Euro filter, an adaptive low-pass filter.
+void one_euro_stroke_filter(StrokeFilter *filter);
+
+// Function that sets filter to keep the points as they were read.
+void raw_stroke_filter(StrokeFilter *filter);
+
+// Function that starts a new stroke, forgetting the points of the previous one.
+void begin_stroke_filter(StrokeFilter *filter);
+
+// Returns the filtered position of point, read at time.
+Vector2 filter_stroke_point(StrokeFilter *filter, Vector2 point, double time);
+
+// Function that ends the stroke on the last point read, which the filtered position lags behind, and returns it.
+Vector2 end_stroke_filter(StrokeFilter *filter);
+
+// Returns where the stroke is expected to be time seconds after its last point, at most MAX_PREDICTION_TIME.
+Vector2 predict_stroke_point(StrokeFilter *filter, float time);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../include/raylib.h"
+#include "../raster.h"
+
+// Fills rectangles, ovals, oval outlines and concave polygons clipped by every side and corner of the canvas, and checks
+// each pixel against the nonzero winding of the flattened path sampled 8x8 times.
+// Run with "make test-clip", add TEST_FLAGS=-fsanitize=address where the compiler has it to catch writes outside the canvas.
+
+#define WIDTH 200
+#define HEIGHT 150
+#define SAMPLES 8
+// Largest difference allowed between a pixel and its samples, a pixel crossed by one edge can be off by about 1/SAMPLES.
+#define TOLERANCE 32
+
+static int winding(const Path *path, float x, float y)
+{
+    int winding = 0;
+    int start = 0;
+    for(int c = 0; c < path->contour_count; c++){
+        int count = path->contours[c];
+        for(int i = 0; i < count; i++){
+            Vector2 a = path->points[start + i];
+            Vector2 b = path->points[start + (i + 1) % count];
+            float side = (b.x - a.x) * (y - a.y) - (x - a.x) * (b.y - a.y);
+            if(a.y <= y && b.y > y && side > 0) winding++;
+            else if(a.y > y && b.y <= y && side < 0) winding--;
+        }
+        start += count;
+    }
+    return winding;
+}
+
+// Fills path on a cleared canvas and returns the largest difference between a pixel and its sampled coverage.
+static int fill_error(Color *pixels, const Path *path)
+{
+    memset(pixels,0,WIDTH * HEIGHT * sizeof(Color));
+    fill_path(pixels,WIDTH,HEIGHT,WIDTH,path,FILL_NON_ZERO,WHITE,NULL);
+
+    float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+    for(int i = 0; i < path->point_count; i++){
+        left = fminf(left,path->points[i].x);
+        top = fminf(top,path->points[i].y);
+        right = fmaxf(right,path->points[i].x);
+        bottom = fmaxf(bottom,path->points[i].y);
+    }
+    int worst = 0;
+    for(int y = 0; y < HEIGHT; y++){
+        for(int x = 0; x < WIDTH; x++){
+            int inside = 0;
+            if(x + 1 > left && x < right && y + 1 > top && y < bottom){
+                for(int j = 0; j < SAMPLES; j++)
+                    for(int i = 0; i < SAMPLES; i++)
+                        inside += winding(path,x + (i + 0.5f) / SAMPLES,y + (j + 0.5f) / SAMPLES) != 0;
+            }
+            int error = abs(pixels[y * WIDTH + x].a - inside * 255 / (SAMPLES * SAMPLES));
+            if(error > worst) worst = error;
+        }
+    }
+    return worst;
+}
+
+int main(void)
+{
+    Color *pixels = malloc(WIDTH * HEIGHT * sizeof(Color));
+    if(!pixels){
+        fprintf(stderr, "Error: failed to allocate memory for the canvas.\n");
+        exit(EXIT_FAILURE);
+    }
+    Path *shape = path();
+    const float sides[3][2] = {{0,0},{0.5f,0.5f},{1,1}};
+    int shapes = 0;
+    int worst = 0;
+
+    // Centers on and half a pixel around every corner and the middle of every side, where the rounding of the
+    // edges moved down the rows used to leave the canvas.
+    for(int side = 0; side < 9; side++){
+        if(side == 4) continue;
+        for(int offset = -2; offset <= 2; offset++){
+            float centerX = sides[side % 3][0] * WIDTH + offset * 0.5f;
+            float centerY = sides[side / 3][1] * HEIGHT - offset * 0.5f;
+            for(int radius = 10; radius <= 46; radius += 4){
+                Vector2 center = {centerX,centerY};
+                int errors[4];
+
+                clear_path(shape);
+                add_rectangle_contour(shape,(Rectangle){centerX - radius * 0.7f,centerY - radius * 0.45f,radius * 1.3f,radius * 0.9f},1);
+                errors[0] = fill_error(pixels,shape);
+
+                clear_path(shape);
+                add_ellipse_contour(shape,center,radius,radius * 0.75f,1);
+                errors[1] = fill_error(pixels,shape);
+
+                clear_path(shape);
+                add_ellipse_contour(shape,center,radius,radius * 0.75f,1);
+                add_ellipse_contour(shape,center,radius - 3,radius * 0.75f - 3,-1);
+                errors[2] = fill_error(pixels,shape);
+
+                clear_path(shape);
+                for(int i = 0; i < 14; i++){
+                    float angle = i * 2 * PI / 14;
+                    float scale = i % 2 ? 0.45f : 1.0f;
+                    add_path_point(shape,(Vector2){centerX + scale * radius * cosf(angle),centerY + scale * radius * 0.9f * sinf(angle)});
+                }
+                close_path_contour(shape);
+                errors[3] = fill_error(pixels,shape);
+
+                for(int i = 0; i < 4; i++){
+                    if(errors[i] > TOLERANCE)
+                        fprintf(stderr, "Error: shape %d of radius %d at (%.1f, %.1f) is off by %d.\n",i,radius,centerX,centerY,errors[i]);
+                    if(errors[i] > worst) worst = errors[i];
+                }
+                shapes += 4;
+            }
+        }
+    }
+
+    printf("%d clipped shapes, largest error %d/255\n",shapes,worst);
+    free_path(shape);
+    free(pixels);
+    return worst <= TOLERANCE ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,177 @@
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+struct s_thread { HANDLE handle; ThreadFunc func; void *arg; };
+struct s_mutex { CRITICAL_SECTION section; };
+struct s_condition { CONDITION_VARIABLE variable; };
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    Thread *thread = (Thread *)param;
+    thread->func(thread->arg);
+    return 0;
+}
+
+Thread *thread_start(ThreadFunc func, void *arg)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    if(!thread) return NULL;
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    if(!thread->handle){
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void thread_join(Thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+int processor_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+Mutex *mutex(void)
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    if(!mutex){
+        fprintf(stderr, "Error: failed to allocate memory for mutex.\n");
+        exit(EXIT_FAILURE);
+    }
+    InitializeCriticalSection(&mutex->section);
+    return mutex;
+}
+
+void mutex_lock(Mutex *mutex) { EnterCriticalSection(&mutex->section); }
+
+void mutex_unlock(Mutex *mutex) { LeaveCriticalSection(&mutex->section); }
+
+void free_mutex(Mutex *mutex)
+{
+    DeleteCriticalSection(&mutex->section);
+    free(mutex);
+}
+
+Condition *condition(void)
+{
+    Condition *condition = malloc(sizeof(Condition));
+    if(!condition){
+        fprintf(stderr, "Error: failed to allocate memory for condition.\n");
+        exit(EXIT_FAILURE);
+    }
+    InitializeConditionVariable(&condition->variable);
+    return condition;
+}
+
+void condition_wait(Condition *condition, Mutex *mutex)
+{
+    SleepConditionVariableCS(&condition->variable, &mutex->section, INFINITE);
+}
+
+void condition_signal(Condition *condition) { WakeConditionVariable(&condition->variable); }
+
+void condition_broadcast(Condition *condition) { WakeAllConditionVariable(&condition->variable); }
+
+void free_condition(Condition *condition) { free(condition); }
+
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+struct s_thread { pthread_t handle; ThreadFunc func; void *arg; };
+struct s_mutex { pthread_mutex_t handle; };
+struct s_condition { pthread_cond_t handle; };
+
+static void *thread_entry(void *param)
+{
+    Thread *thread = (Thread *)param;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+Thread *thread_start(ThreadFunc func, void *arg)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    if(!thread) return NULL;
+    thread->func = func;
+    thread->arg = arg;
+    if(pthread_create(&thread->handle, NULL, thread_entry, thread) != 0){
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void thread_join(Thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+int processor_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+Mutex *mutex(void)
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    if(!mutex){
+        fprintf(stderr, "Error: failed to allocate memory for mutex.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&mutex->handle, NULL);
+    return mutex;
+}
+
+void mutex_lock(Mutex *mutex) { pthread_mutex_lock(&mutex->handle); }
+
+void mutex_unlock(Mutex *mutex) { pthread_mutex_unlock(&mutex->handle); }
+
+void free_mutex(Mutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->handle);
+    free(mutex);
+}
+
+Condition *condition(void)
+{
+    Condition *condition = malloc(sizeof(Condition));
+    if(!condition){
+        fprintf(stderr, "Error: failed to allocate memory for condition.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_cond_init(&condition->handle, NULL);
+    return condition;
+}
+
+void condition_wait(Condition *condition, Mutex *mutex)
+{
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+}
+
+void condition_signal(Condition *condition) { pthread_cond_signal(&condition->handle); }
+
+void condition_broadcast(Condition *condition) { pthread_cond_broadcast(&condition->handle); }
+
+void free_condition(Condition *condition)
+{
+    pthread_cond_destroy(&condition->handle);
+    free(condition);
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+// Thin wrapper over the threads of the operating system, Win32 threads on Windows and pthreads elsewhere.
+// It lives in its own file because windows.h clashes with raylib.h.
+
+typedef struct s_thread Thread;
+typedef struct s_mutex Mutex;
+typedef struct s_condition Condition;
+
+typedef void (*ThreadFunc)(void *);
+
+// Starts a thread running func(arg) and returns a pointer to it, or NULL if it couldn't be started.
+Thread *thread_start(ThreadFunc func, void *arg);
+
+// Function that waits for the thread to finish and frees its memory.
+void thread_join(Thread *thread);
+
+// Returns the number of processors the threads can run on, at least 1.
+int processor_count(void);
+
+// Creates an unlocked mutex and returns a pointer to it.
+Mutex *mutex(void);
+
+void mutex_lock(Mutex *mutex);
+
+void mutex_unlock(Mutex *mutex);
+
+void free_mutex(Mutex *mutex);
+
+// Creates a condition variable and returns a pointer to it.
+Condition *condition(void);
+
+// Function that unlocks mutex, waits until the condition is signaled and locks mutex again.
+void condition_wait(Condition *condition, Mutex *mutex);
+
+// Function that wakes up one thread waiting on the condition.
+void condition_signal(Condition *condition);
+
+// Function that wakes up every thread waiting on the condition.
+void condition_broadcast(Condition *condition);
+
+void free_condition(Condition *condition);
+
+#endif